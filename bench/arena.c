@@ -0,0 +1,75 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Arena benchmark
+// Compares growing a heap arena, which reallocates and copies its buffer, with a virtual arena, which commits pages
+// in place.  Each run allocates K_BENCH_TOTAL bytes in small pieces and then pops them all, reporting the time taken
+// and the resident memory before and after the pop.
+//
+// The peak working set covers the whole process, so pass "heap" or "virtual" to run one kind of arena on its own
+// and read its peak.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_IMPLEMENTATION
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define K_BENCH_TOTAL   ((i64)MB(512))
+#define K_BENCH_PIECE   64
+
+internal void benchArena(const char* name, Arena* arena)
+{
+    i64 count = K_BENCH_TOTAL / K_BENCH_PIECE;
+    i64 base = benchWorkingSet();
+    Time t;
+
+    printf("%s arena:\n", name);
+
+    if (!arenaPush(arena))
+    {
+        printf("    out of memory\n");
+        return;
+    }
+    timerStart(&t);
+    for (i64 i = 0; i < count; ++i)
+    {
+        u8* p = (u8 *)arenaAlloc(arena, K_BENCH_PIECE);
+        if (!p)
+        {
+            printf("    out of memory after %lld bytes\n", i * K_BENCH_PIECE);
+            break;
+        }
+        p[0] = (u8)i;
+    }
+    benchReport("    grow", timerEnd(&t), count);
+    benchReportMemory("    resident after growing", benchWorkingSet() - base);
+
+    timerStart(&t);
+    arenaPop(arena);
+    benchReportTime("    pop", timerEnd(&t));
+    benchReportMemory("    resident after popping", benchWorkingSet() - base);
+
+    arenaDone(arena);
+    benchReportMemory("    peak working set of the process", benchPeakWorkingSet());
+}
+
+int kmain(int argc, char** argv)
+{
+    const char* only = argc > 1 ? argv[1] : 0;
+    Arena arena;
+
+    if (!only || strcmp(only, "heap") == 0)
+    {
+        arenaInit(&arena, K_ARENA_INCREMENT);
+        benchArena("Heap", &arena);
+    }
+
+    if (!only || strcmp(only, "virtual") == 0)
+    {
+        arenaInitVirtual(&arena, K_BENCH_TOTAL * 2);
+        benchArena("Virtual", &arena);
+    }
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Array growth benchmark
+// Appends elements one at a time to an array that grows on the heap with K_REALLOC, and to one that moves to
+// reserved virtual memory past K_ARRAY_VIRTUAL_THRESHOLD and grows in place from then on.  Reports the time taken and
+// how many times the array moved.
+//
+// The default of 1e9 i32 elements needs 4GB for the array, and up to twice that while the heap array is being
+// copied.  Pass a smaller count as the first argument on smaller machines, and "heap" or "virtual" as the second to
+// run one path on its own and read its peak working set.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_IMPLEMENTATION
+#include <kore/k_platform.h>
+
+// Read the threshold from a variable so that the heap path can be measured by raising it
+#define K_ARRAY_VIRTUAL_THRESHOLD gBenchVirtualThreshold
+i64 gBenchVirtualThreshold;
+
+#include <kore/k_memory.h>
+#include <string.h>
+
+#include "bench.h"
+
+internal void benchGrowth(const char* name, i64 count)
+{
+    Array(i32) a = 0;
+    i32* last = 0;
+    i64 moves = 0;
+    Time t;
+
+    timerStart(&t);
+    for (i64 i = 0; i < count; ++i)
+    {
+        arrayAdd(a, (i32)i);
+        if (a != last)
+        {
+            if (!a)
+            {
+                printf("%s: out of memory after %lld elements\n", name, i);
+                return;
+            }
+            last = a;
+            ++moves;
+        }
+    }
+    benchReport(name, timerEnd(&t), count);
+    printf("    %lld moves, %s storage\n", moves,
+        K_ARRAY_KIND(__arrayHeader(a)->storage) == K_ARRAY_VIRTUAL ? "virtual" : "heap");
+    benchReportMemory("    peak working set of the process", benchPeakWorkingSet());
+
+    arrayRelease(a);
+}
+
+int kmain(int argc, char** argv)
+{
+    i64 count = argc > 1 ? _atoi64(argv[1]) : 1000000000;
+    const char* only = argc > 2 ? argv[2] : 0;
+
+    if (!only || strcmp(only, "heap") == 0)
+    {
+        gBenchVirtualThreshold = (i64)1 << 62;
+        benchGrowth("heap, grow with K_REALLOC", count);
+    }
+
+    if (!only || strcmp(only, "virtual") == 0)
+    {
+        gBenchVirtualThreshold = MB(64);
+        benchGrowth("virtual, grow in place", count);
+    }
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Benchmark helpers
+// Shared by the benchmarks in this directory.  Each benchmark is a single program that defines K_IMPLEMENTATION and
+// includes the kore headers it measures, so it builds on its own, for example:
+//
+//      cl /O2 /I<directory containing kore> arena.c
+//
+// Times are wall-clock times from the platform timer.  Run on an otherwise idle machine and take the best of a few
+// runs.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <kore/k_platform.h>
+
+#if OS_WIN32
+#   include <psapi.h>
+#   pragma comment(lib, "psapi.lib")
+#endif
+
+// Return the number of bytes of the process's memory that are resident.
+internal i64 benchWorkingSet()
+{
+#if OS_WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? (i64)counters.WorkingSetSize : 0;
+#else
+#   error Implement benchWorkingSet for your OS.
+#endif
+}
+
+// Return the most bytes that have been resident at once since the process started.
+internal i64 benchPeakWorkingSet()
+{
+#if OS_WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ?
+        (i64)counters.PeakWorkingSetSize : 0;
+#else
+#   error Implement benchPeakWorkingSet for your OS.
+#endif
+}
+
+// Return the number of logical processors.
+internal int benchNumProcessors()
+{
+#if OS_WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+#   error Implement benchNumProcessors for your OS.
+#endif
+}
+
+//
+// Threads
+//
+
+#define K_BENCH_MAX_THREADS 64
+
+typedef void (*BenchThreadFunc)(void* context);
+
+typedef struct
+{
+    BenchThreadFunc func;
+    void*           context;
+}
+BenchThread;
+
+volatile LONG gBenchGo;
+
+#if OS_WIN32
+internal DWORD WINAPI __benchThreadMain(LPVOID param)
+{
+    BenchThread* thread = (BenchThread *)param;
+
+    // Wait for the other threads to be created so that they all start together
+    while (!gBenchGo) YieldProcessor();
+    thread->func(thread->context);
+    return 0;
+}
+#endif
+
+// Run func on numThreads threads at once, passing thread i the context at contexts + i * contextSize.  Returns the
+// number of seconds from starting the threads until the last one finishes.
+internal f64 benchRunThreads(int numThreads, BenchThreadFunc func, void* contexts, i64 contextSize)
+{
+    BenchThread threads[K_BENCH_MAX_THREADS];
+    Time t;
+    f64 seconds;
+
+    K_ASSERT(numThreads <= K_BENCH_MAX_THREADS, "Too many benchmark threads");
+    gBenchGo = 0;
+
+#if OS_WIN32
+    {
+        HANDLE handles[K_BENCH_MAX_THREADS];
+
+        for (int i = 0; i < numThreads; ++i)
+        {
+            threads[i].func = func;
+            threads[i].context = (u8 *)contexts + i * contextSize;
+            handles[i] = CreateThread(0, 0, __benchThreadMain, &threads[i], 0, 0);
+        }
+
+        timerStart(&t);
+        gBenchGo = 1;
+        WaitForMultipleObjects((DWORD)numThreads, handles, TRUE, INFINITE);
+        seconds = timerEnd(&t);
+
+        for (int i = 0; i < numThreads; ++i) CloseHandle(handles[i]);
+    }
+#else
+#   error Implement benchRunThreads for your OS.
+#endif
+
+    return seconds;
+}
+
+//
+// Reporting
+//
+
+// Print the time taken to do something once.
+internal void benchReportTime(const char* name, f64 seconds)
+{
+    printf("%-44s %10.2f ms\n", name, seconds * 1000.0);
+}
+
+// Print the time taken to do count operations.
+internal void benchReport(const char* name, f64 seconds, i64 count)
+{
+    printf("%-44s %10.2f ms %10.2f ns/op %10.2f Mop/s\n", name, seconds * 1000.0, seconds * 1e9 / (f64)count,
+        (f64)count / seconds / 1e6);
+}
+
+// Print the time taken to process numBytes bytes.
+internal void benchReportBytes(const char* name, f64 seconds, i64 numBytes)
+{
+    printf("%-44s %10.2f ms %10.2f GB/s\n", name, seconds * 1000.0, (f64)numBytes / seconds / (f64)GB(1));
+}
+
+// Print a number of bytes in MB.
+internal void benchReportMemory(const char* name, i64 numBytes)
+{
+    printf("%-44s %10.1f MB\n", name, (f64)numBytes / (f64)MB(1));
+}
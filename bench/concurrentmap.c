@@ -0,0 +1,150 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Concurrent map benchmark
+// Readers look up random keys in a map of K_BENCH_KEYS keys, from one thread up to every processor.  The concurrent
+// map is compared with a HashMap behind a reader-writer lock taken shared for lookups.  Each is run with readers only
+// and with one extra thread changing values as fast as it can while the readers run.  The lookups per second should
+// grow with the readers for the concurrent map, with or without the writer.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_IMPLEMENTATION
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+#include <kore/k_hashmap.h>
+#include <kore/k_concurrentmap.h>
+#include <kore/k_random.h>
+
+#include "bench.h"
+
+#define K_BENCH_KEYS        65536
+#define K_BENCH_LOOKUPS     4000000
+
+typedef struct
+{
+    ConcurrentMap   concurrentMap;
+    HashMap         hashMap;
+    SRWLOCK         lock;
+    volatile LONG   readersLeft;    // Readers still running, so the writer knows when to stop.
+}
+BenchMaps;
+
+typedef struct
+{
+    BenchMaps*  maps;
+    bool        locked;             // Use the locked HashMap rather than the concurrent map.
+    bool        writer;
+    i64         seed;
+    i64         hits;
+}
+BenchMapThread;
+
+internal void benchMapThread(void* context)
+{
+    BenchMapThread* thread = (BenchMapThread *)context;
+    BenchMaps* maps = thread->maps;
+    Random r;
+
+    randomInitSeed(&r, thread->seed);
+
+    if (thread->writer)
+    {
+        for (i64 n = 0; maps->readersLeft; ++n)
+        {
+            i64 key = (i64)(random64(&r) % K_BENCH_KEYS);
+
+            if (thread->locked)
+            {
+                AcquireSRWLockExclusive(&maps->lock);
+                *(i64 *)hashMapAdd(&maps->hashMap, &key, 0) = n;
+                ReleaseSRWLockExclusive(&maps->lock);
+            }
+            else
+            {
+                concurrentMapSet(&maps->concurrentMap, &key, &n, 0);
+            }
+        }
+    }
+    else
+    {
+        for (i64 i = 0; i < K_BENCH_LOOKUPS; ++i)
+        {
+            i64 key = (i64)(random64(&r) % K_BENCH_KEYS);
+            i64 value;
+
+            if (thread->locked)
+            {
+                i64* p;
+
+                AcquireSRWLockShared(&maps->lock);
+                p = (i64 *)hashMapFind(&maps->hashMap, &key);
+                if (p) value = *p;
+                ReleaseSRWLockShared(&maps->lock);
+                thread->hits += p != 0;
+            }
+            else
+            {
+                thread->hits += concurrentMapFind(&maps->concurrentMap, &key, &value);
+            }
+        }
+        InterlockedDecrement(&maps->readersLeft);
+    }
+
+    concurrentMapThreadDone();
+}
+
+int kmain(int argc, char** argv)
+{
+    int maxThreads = K_MIN(benchNumProcessors(), K_BENCH_MAX_THREADS - 1);
+    BenchMapThread threads[K_BENCH_MAX_THREADS];
+    BenchMaps maps;
+
+    if (!K_CONCURRENTMAP_INIT(&maps.concurrentMap, i64, i64))
+    {
+        printf("Could not initialise the concurrent map.\n");
+        return 1;
+    }
+    hashMapInit(&maps.hashMap, sizeof(i64), sizeof(i64));
+    InitializeSRWLock(&maps.lock);
+    for (i64 key = 0; key < K_BENCH_KEYS; ++key)
+    {
+        concurrentMapSet(&maps.concurrentMap, &key, &key, 0);
+        *(i64 *)hashMapAdd(&maps.hashMap, &key, 0) = key;
+    }
+
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+    {
+        for (int writing = 0; writing < 2; ++writing)
+        {
+            for (int locked = 0; locked < 2; ++locked)
+            {
+                char name[64];
+                i64 hits = 0;
+
+                for (int i = 0; i < numThreads + writing; ++i)
+                {
+                    threads[i].maps = &maps;
+                    threads[i].locked = (bool)locked;
+                    threads[i].writer = K_BOOL(i == numThreads);
+                    threads[i].seed = i + 1;
+                    threads[i].hits = 0;
+                }
+                maps.readersLeft = numThreads;
+
+                snprintf(name, sizeof(name), "%s, %d reader%s%s", locked ? "locked" : "concurrent", numThreads,
+                    numThreads == 1 ? "" : "s", writing ? " + writer" : "");
+                benchReport(name, benchRunThreads(numThreads + writing, benchMapThread, threads, sizeof(threads[0])),
+                    (i64)K_BENCH_LOOKUPS * numThreads);
+
+                for (int i = 0; i < numThreads; ++i) hits += threads[i].hits;
+                if (hits != (i64)K_BENCH_LOOKUPS * numThreads) printf("    %lld lookups missed!\n",
+                    (i64)K_BENCH_LOOKUPS * numThreads - hits);
+            }
+        }
+
+        if (numThreads < maxThreads && numThreads * 2 > maxThreads) numThreads = maxThreads / 2;
+    }
+
+    concurrentMapDone(&maps.concurrentMap);
+    hashMapDone(&maps.hashMap);
+
+    return 0;
+}
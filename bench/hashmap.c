@@ -0,0 +1,93 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Hash map benchmark
+// Compares HashMap with the StringTable path for interning and looking up strings.  The string table's bucket count
+// is fixed when it is created, so it is measured with a typical 64K buckets and with one bucket per string.  The
+// hash map stores the strings inline as fixed-size keys, cleared past their ends so they compare bytewise.  Hash map
+// lookups of keys that are not in the map are timed too; the string table has no lookup that does not add.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_IMPLEMENTATION
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+#include <kore/k_string.h>
+#include <kore/k_hashmap.h>
+#include <kore/k_random.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define K_BENCH_COUNT   1000000
+#define K_BENCH_KEY     32
+
+typedef struct
+{
+    i8      str[K_BENCH_KEY];
+}
+BenchKey;
+
+internal void benchStringTable(const char* name, const BenchKey* keys, i64 numBuckets)
+{
+    StringTable table;
+    char label[64];
+    Time t;
+
+    stringTableInit(&table, MB(64), numBuckets);
+
+    timerStart(&t);
+    for (i64 i = 0; i < K_BENCH_COUNT; ++i) stringTableAdd(&table, keys[i].str);
+    snprintf(label, sizeof(label), "%s, insert", name);
+    benchReport(label, timerEnd(&t), K_BENCH_COUNT);
+
+    timerStart(&t);
+    for (i64 i = 0; i < K_BENCH_COUNT; ++i) stringTableAdd(&table, keys[i].str);
+    snprintf(label, sizeof(label), "%s, lookup", name);
+    benchReport(label, timerEnd(&t), K_BENCH_COUNT);
+
+    stringTableDone(&table);
+}
+
+internal void benchHashMap(const BenchKey* keys, const BenchKey* missing)
+{
+    HashMap map;
+    i64 found = 0;
+    Time t;
+
+    K_HASHMAP_INIT(&map, BenchKey, i64);
+
+    timerStart(&t);
+    for (i64 i = 0; i < K_BENCH_COUNT; ++i) *K_HASHMAP_ADD(&map, &keys[i], i64, 0) = i;
+    benchReport("hash map, insert", timerEnd(&t), K_BENCH_COUNT);
+
+    timerStart(&t);
+    for (i64 i = 0; i < K_BENCH_COUNT; ++i) found += hashMapFind(&map, &keys[i]) != 0;
+    benchReport("hash map, lookup", timerEnd(&t), K_BENCH_COUNT);
+
+    timerStart(&t);
+    for (i64 i = 0; i < K_BENCH_COUNT; ++i) found += hashMapFind(&map, &missing[i]) != 0;
+    benchReport("hash map, lookup missing key", timerEnd(&t), K_BENCH_COUNT);
+
+    if (found != K_BENCH_COUNT) printf("hash map found %lld keys, expected %d\n", found, K_BENCH_COUNT);
+    hashMapDone(&map);
+}
+
+int kmain(int argc, char** argv)
+{
+    BenchKey* keys = K_ALLOC(sizeof(BenchKey) * K_BENCH_COUNT * 2);
+    BenchKey* missing = keys + K_BENCH_COUNT;
+    Random r;
+
+    // Every key is unique since the counter is part of it
+    randomInitSeed(&r, 1234);
+    memoryClear(keys, sizeof(BenchKey) * K_BENCH_COUNT * 2);
+    for (i64 i = 0; i < K_BENCH_COUNT * 2; ++i)
+    {
+        snprintf(keys[i].str, K_BENCH_KEY, "item-%llx-%lld", random64(&r) & 0xffffff, i);
+    }
+
+    benchStringTable("string table, 64K buckets", keys, KB(64));
+    benchStringTable("string table, 1M buckets", keys, K_BENCH_COUNT);
+    benchHashMap(keys, missing);
+
+    K_FREE(keys, sizeof(BenchKey) * K_BENCH_COUNT * 2);
+    return 0;
+}
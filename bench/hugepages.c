@@ -0,0 +1,85 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Large page benchmark
+// Measures random reads over a big arena and a big array, with and without large (2MB) pages.  The reads are a
+// dependent chain through a random cycle, so each one waits for the last and TLB misses are not hidden.
+//
+// Large pages need the "Lock pages in memory" privilege.  Without it the large page runs fall back to normal pages,
+// which is reported.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_IMPLEMENTATION
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+#include <kore/k_random.h>
+
+#include "bench.h"
+
+#define K_BENCH_SIZE    ((i64)MB(1024))
+#define K_BENCH_READS   20000000
+
+// Link the elements of table into one random cycle (Sattolo's algorithm) so that following it visits them all.
+internal void benchBuildCycle(u32* table, i64 count, Random* r)
+{
+    for (i64 i = 0; i < count; ++i) table[i] = (u32)i;
+    for (i64 i = count - 1; i > 0; --i)
+    {
+        i64 j = (i64)(random64(r) % (u64)i);
+        K_SWAP(u32, table[i], table[j]);
+    }
+}
+
+internal void benchChase(const char* name, const u32* table)
+{
+    u32 i = 0;
+    Time t;
+
+    timerStart(&t);
+    for (i64 n = 0; n < K_BENCH_READS; ++n) i = table[i];
+    benchReport(name, timerEnd(&t), K_BENCH_READS);
+
+    // Keep the chain from being optimised away
+    if (i == 0xffffffff) printf("\n");
+}
+
+int kmain(int argc, char** argv)
+{
+    i64 count = K_BENCH_SIZE / sizeof(u32);
+    Random r;
+
+    randomInitSeed(&r, 1234);
+
+    // Arenas
+    for (int huge = 0; huge < 2; ++huge)
+    {
+        Arena arena = { 0 };
+        u32* table;
+
+        if (huge) arenaInitHuge(&arena, K_BENCH_SIZE); else arenaInitVirtual(&arena, K_BENCH_SIZE);
+        table = K_ARENA_ALLOC(&arena, u32, count);
+        if (!table)
+        {
+            printf("Could not allocate %lld bytes on an arena\n", K_BENCH_SIZE);
+            return 1;
+        }
+
+        benchBuildCycle(table, count, &r);
+        benchChase(arena.kind == K_ARENA_HUGE ? "arena, large pages" :
+            huge ? "arena, large pages not available" : "arena, normal pages", table);
+        arenaDone(&arena);
+    }
+
+    // Arrays
+    for (int huge = 0; huge < 2; ++huge)
+    {
+        Array(u32) table = 0;
+
+        if (huge) arrayReserveHuge(table, count); else arrayReserve(table, count);
+        arrayExpand(table, count);
+
+        benchBuildCycle(table, count, &r);
+        benchChase(huge ? "array, large pages if available" : "array, normal pages", table);
+        arrayRelease(table);
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Copy and clear benchmark
+// Compares memoryCopy and memoryClear with the C runtime's memcpy and memset for sizes from 64 bytes to 1GB, then
+// measures how much of a warm working set survives clearing a large buffer.  Blocks at least as big as the streaming
+// threshold are written with non-temporal stores by memoryClear, so the working set should stay in the cache.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_IMPLEMENTATION
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define K_BENCH_MAX_SIZE    ((i64)GB(1))
+#define K_BENCH_BYTES       ((i64)GB(1) * 4)    // Bytes processed for each size.
+#define K_BENCH_HOT_SIZE    KB(512)
+
+// Called through pointers so the compiler can not inline or drop them
+typedef void* (*BenchMemcpy)(void* dst, const void* src, size_t numBytes);
+typedef void* (*BenchMemset)(void* dst, int value, size_t numBytes);
+
+BenchMemcpy volatile gBenchMemcpy = &memcpy;
+BenchMemset volatile gBenchMemset = &memset;
+
+// Sum the working set and return the time taken.
+internal f64 benchReadHot(const i64* hot, i64* sum)
+{
+    Time t;
+
+    timerStart(&t);
+    for (i64 i = 0; i < K_BENCH_HOT_SIZE / (i64)sizeof(i64); ++i) *sum += hot[i];
+    return timerEnd(&t);
+}
+
+int kmain(int argc, char** argv)
+{
+    u8* src = (u8 *)K_ALLOC_ALIGNED(K_BENCH_MAX_SIZE, 64);
+    u8* dst = (u8 *)K_ALLOC_ALIGNED(K_BENCH_MAX_SIZE, 64);
+    i64* hot = (i64 *)K_ALLOC_ALIGNED(K_BENCH_HOT_SIZE, 64);
+    i64 sum = 0;
+
+    if (!src || !dst || !hot)
+    {
+        printf("Could not allocate the buffers\n");
+        return 1;
+    }
+
+    // Commit every page up front so that page faults are not measured
+    memset(src, 1, (size_t)K_BENCH_MAX_SIZE);
+    memset(dst, 0, (size_t)K_BENCH_MAX_SIZE);
+    memset(hot, 0, K_BENCH_HOT_SIZE);
+
+    printf("Streaming threshold is %lld bytes\n", (i64)K_MEMORY_STREAMING_THRESHOLD);
+    for (i64 size = 64; size <= K_BENCH_MAX_SIZE; size *= 4)
+    {
+        i64 iterations = K_MAX(K_BENCH_BYTES / size, 1);
+        Time t;
+
+        printf("%lld bytes:\n", size);
+
+        timerStart(&t);
+        for (i64 i = 0; i < iterations; ++i) memoryCopy(src, dst, size);
+        benchReportBytes("    memoryCopy", timerEnd(&t), iterations * size);
+
+        timerStart(&t);
+        for (i64 i = 0; i < iterations; ++i) gBenchMemcpy(dst, src, (size_t)size);
+        benchReportBytes("    memcpy", timerEnd(&t), iterations * size);
+
+        timerStart(&t);
+        for (i64 i = 0; i < iterations; ++i) memoryClear(dst, size);
+        benchReportBytes("    memoryClear", timerEnd(&t), iterations * size);
+
+        timerStart(&t);
+        for (i64 i = 0; i < iterations; ++i) gBenchMemset(dst, 0, (size_t)size);
+        benchReportBytes("    memset", timerEnd(&t), iterations * size);
+    }
+
+    // Cache pollution: time reading a warm working set after clearing the whole buffer
+    printf("Reading %d KB after clearing %lld MB:\n", K_BENCH_HOT_SIZE / 1024, K_BENCH_MAX_SIZE / MB(1));
+    benchReadHot(hot, &sum);
+    benchReportTime("    warm, nothing cleared", benchReadHot(hot, &sum));
+    memoryClear(dst, K_BENCH_MAX_SIZE);
+    benchReportTime("    after memoryClear", benchReadHot(hot, &sum));
+    benchReadHot(hot, &sum);
+    gBenchMemset(dst, 0, (size_t)K_BENCH_MAX_SIZE);
+    benchReportTime("    after memset", benchReadHot(hot, &sum));
+
+    K_FREE_ALIGNED(hot, K_BENCH_HOT_SIZE, 64);
+    K_FREE_ALIGNED(dst, K_BENCH_MAX_SIZE, 64);
+    K_FREE_ALIGNED(src, K_BENCH_MAX_SIZE, 64);
+
+    return sum == 1 ? 1 : 0;
+}
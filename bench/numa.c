@@ -0,0 +1,109 @@
+//----------------------------------------------------------------------------------------------------------------------
+// NUMA benchmark
+// Pins the thread to the processors of node 0, then reads and writes K_BENCH_SIZE bytes committed on each node in
+// turn, through an arena from arenaInitNuma and an array from arrayReserveNuma.  Node 0 is local memory and every
+// other node is remote, so the difference between them is what placing memory on the right node is worth.  On a
+// machine with one node only the local figures are printed.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_IMPLEMENTATION
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+
+#include "bench.h"
+
+#define K_BENCH_SIZE    ((i64)MB(512))
+#define K_BENCH_PASSES  8
+
+volatile u64 gBenchSink;
+
+// Run the current thread on the processors of a node only.
+internal bool benchPinToNode(i64 node)
+{
+#if OS_WIN32
+    GROUP_AFFINITY affinity = { 0 };
+
+    return GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) &&
+        SetThreadGroupAffinity(GetCurrentThread(), &affinity, 0);
+#else
+#   error Implement benchPinToNode for your OS.
+#endif
+}
+
+internal void benchMeasure(const char* kind, i64 node, u64* words)
+{
+    i64 count = K_BENCH_SIZE / (i64)sizeof(u64);
+    char name[64];
+    Time t;
+
+    // Touch every page once so that the commits are not timed
+    for (i64 i = 0; i < count; i += K_PAGE_SIZE / sizeof(u64)) words[i] = (u64)i;
+
+    timerStart(&t);
+    for (int pass = 0; pass < K_BENCH_PASSES; ++pass)
+    {
+        u64 a = 0, b = 0, c = 0, d = 0;
+
+        for (i64 i = 0; i < count; i += 4)
+        {
+            a += words[i + 0];
+            b += words[i + 1];
+            c += words[i + 2];
+            d += words[i + 3];
+        }
+        gBenchSink += a + b + c + d;
+    }
+    snprintf(name, sizeof(name), "%s on node %lld, read", kind, node);
+    benchReportBytes(name, timerEnd(&t), K_BENCH_SIZE * K_BENCH_PASSES);
+
+    timerStart(&t);
+    for (int pass = 0; pass < K_BENCH_PASSES; ++pass)
+    {
+        for (i64 i = 0; i < count; ++i) words[i] = (u64)(i + pass);
+    }
+    snprintf(name, sizeof(name), "%s on node %lld, write", kind, node);
+    benchReportBytes(name, timerEnd(&t), K_BENCH_SIZE * K_BENCH_PASSES);
+}
+
+int kmain(int argc, char** argv)
+{
+    i64 numNodes = memoryNumaNodeCount();
+
+    if (!benchPinToNode(0))
+    {
+        printf("Could not run on the processors of node 0.\n");
+        return 1;
+    }
+    if (numNodes == 1) printf("This machine has one NUMA node, so there is no remote memory to compare.\n");
+
+    for (i64 node = 0; node < numNodes; ++node)
+    {
+        Arena arena;
+        Array(u64) array = 0;
+
+        arenaInitNuma(&arena, K_BENCH_SIZE, node);
+        if (arena.start)
+        {
+            benchMeasure(node ? "Arena (remote)" : "Arena (local)", node, (u64 *)arenaAlloc(&arena, K_BENCH_SIZE));
+            arenaDone(&arena);
+        }
+        else
+        {
+            printf("Could not reserve an arena on node %lld.\n", node);
+        }
+
+        arrayReserveNuma(array, K_BENCH_SIZE / (i64)sizeof(u64), node);
+        if (array)
+        {
+            arrayExpand(array, K_BENCH_SIZE / (i64)sizeof(u64));
+            benchMeasure(node ? "Array (remote)" : "Array (local)", node, array);
+            arrayRelease(array);
+        }
+        else
+        {
+            printf("Could not reserve an array on node %lld.\n", node);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,219 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Queue benchmark
+// Throughput: producers push K_BENCH_COUNT elements in total and the same number of consumers pop them, one at a
+// time and in batches.  The SPSC queue has one of each; the MPMC queue is run with more and more pairs up to the
+// number of processors, so the contention on its indices grows.
+//
+// Latency: two threads bounce an element back and forth through a pair of queues.  Half the round trip is the time
+// an element takes to get from one thread to the other.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_IMPLEMENTATION
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+#include <kore/k_queue.h>
+
+#include "bench.h"
+
+#define K_BENCH_COUNT       20000000
+#define K_BENCH_ROUND_TRIPS 1000000
+#define K_BENCH_CAPACITY    4096
+#define K_BENCH_BATCH       64
+
+typedef struct
+{
+    SpscQueue*  spsc;           // One of these is used.
+    MpmcQueue*  mpmc;
+    bool        producer;
+    i64         count;          // Number of elements to push or pop.
+    i64         batch;
+    u64         sum;            // Sum of the elements popped.
+    u8          pad[K_CACHE_LINE_SIZE];
+}
+BenchQueueThread;
+
+// Push or pop through whichever queue is given.
+internal i64 benchPush(SpscQueue* spsc, MpmcQueue* mpmc, const u64* elems, i64 count)
+{
+    return spsc ? spscQueuePushBatch(spsc, elems, count) : mpmcQueuePushBatch(mpmc, elems, count);
+}
+
+internal i64 benchPop(SpscQueue* spsc, MpmcQueue* mpmc, u64* elems, i64 count)
+{
+    return spsc ? spscQueuePopBatch(spsc, elems, count) : mpmcQueuePopBatch(mpmc, elems, count);
+}
+
+internal void benchQueueThread(void* context)
+{
+    BenchQueueThread* thread = (BenchQueueThread *)context;
+    u64 elems[K_BENCH_BATCH];
+    i64 done = 0;
+
+    while (done < thread->count)
+    {
+        i64 n = K_MIN(thread->batch, thread->count - done);
+
+        if (thread->producer)
+        {
+            for (i64 i = 0; i < n; ++i) elems[i] = (u64)(done + i);
+            n = benchPush(thread->spsc, thread->mpmc, elems, n);
+        }
+        else
+        {
+            n = benchPop(thread->spsc, thread->mpmc, elems, n);
+            for (i64 i = 0; i < n; ++i) thread->sum += elems[i];
+        }
+
+        if (!n) YieldProcessor();
+        done += n;
+    }
+}
+
+// Run numPairs producers and numPairs consumers through a queue.
+internal void benchThroughput(const char* name, SpscQueue* spsc, MpmcQueue* mpmc, int numPairs, i64 batch)
+{
+    BenchQueueThread threads[K_BENCH_MAX_THREADS];
+    i64 perThread = K_BENCH_COUNT / numPairs;
+    u64 expected = (u64)numPairs * (u64)perThread * (u64)(perThread - 1) / 2;
+    u64 sum = 0;
+    char label[64];
+    f64 seconds;
+
+    for (int i = 0; i < numPairs * 2; ++i)
+    {
+        threads[i].spsc = spsc;
+        threads[i].mpmc = mpmc;
+        threads[i].producer = (bool)(i < numPairs);
+        threads[i].count = perThread;
+        threads[i].batch = batch;
+        threads[i].sum = 0;
+    }
+
+    seconds = benchRunThreads(numPairs * 2, benchQueueThread, threads, sizeof(threads[0]));
+    for (int i = numPairs; i < numPairs * 2; ++i) sum += threads[i].sum;
+
+    snprintf(label, sizeof(label), "%s, %dP/%dC, batch %lld", name, numPairs, numPairs, batch);
+    benchReport(label, seconds, perThread * numPairs);
+    if (sum != expected) printf("    wrong elements popped\n");
+}
+
+//
+// Latency
+//
+
+typedef struct
+{
+    SpscQueue*  spsc[2];        // Queues in each direction; one pair is used.
+    MpmcQueue*  mpmc[2];
+    bool        first;          // Whether this thread starts each round trip.
+    u8          pad[K_CACHE_LINE_SIZE];
+}
+BenchPingThread;
+
+internal void benchPingThread(void* context)
+{
+    BenchPingThread* thread = (BenchPingThread *)context;
+    int in = thread->first ? 1 : 0;
+    int out = 1 - in;
+
+    for (i64 i = 0; i < K_BENCH_ROUND_TRIPS; ++i)
+    {
+        u64 elem = (u64)i;
+
+        if (thread->first)
+        {
+            while (!benchPush(thread->spsc[out], thread->mpmc[out], &elem, 1)) YieldProcessor();
+        }
+        while (!benchPop(thread->spsc[in], thread->mpmc[in], &elem, 1)) YieldProcessor();
+        if (!thread->first)
+        {
+            while (!benchPush(thread->spsc[out], thread->mpmc[out], &elem, 1)) YieldProcessor();
+        }
+    }
+}
+
+internal void benchLatency(const char* name, SpscQueue* spsc, MpmcQueue* mpmc)
+{
+    BenchPingThread threads[2];
+    f64 seconds;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        threads[i].spsc[0] = spsc ? &spsc[0] : 0;
+        threads[i].spsc[1] = spsc ? &spsc[1] : 0;
+        threads[i].mpmc[0] = mpmc ? &mpmc[0] : 0;
+        threads[i].mpmc[1] = mpmc ? &mpmc[1] : 0;
+        threads[i].first = (bool)(i == 0);
+    }
+
+    seconds = benchRunThreads(2, benchPingThread, threads, sizeof(threads[0]));
+    benchReport(name, seconds / 2, K_BENCH_ROUND_TRIPS);
+}
+
+// Batches of no elements must return straight away, whether or not the first cell is ready.
+internal bool benchEmptyBatches(SpscQueue* spsc, MpmcQueue* mpmc)
+{
+    u64 elem = 1;
+    bool ok = YES;
+
+    for (int filled = 0; filled < 2; ++filled)
+    {
+        ok = ok && !spscQueuePushBatch(spsc, &elem, 0) && !spscQueuePopBatch(spsc, &elem, 0);
+        ok = ok && !mpmcQueuePushBatch(mpmc, &elem, 0) && !mpmcQueuePopBatch(mpmc, &elem, 0);
+        if (!filled)
+        {
+            spscQueuePush(spsc, &elem);
+            mpmcQueuePush(mpmc, &elem);
+        }
+    }
+
+    // Leave the queues empty for the benchmarks
+    ok = ok && spscQueuePop(spsc, &elem) && mpmcQueuePop(mpmc, &elem);
+    return ok;
+}
+
+int kmain(int argc, char** argv)
+{
+    int maxPairs = K_MIN(benchNumProcessors(), K_BENCH_MAX_THREADS) / 2;
+    SpscQueue spsc[2];
+    MpmcQueue mpmc[2];
+
+    if (maxPairs < 1)
+    {
+        printf("The queue benchmark needs at least 2 processors\n");
+        return 1;
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        spscQueueInit(&spsc[i], sizeof(u64), K_BENCH_CAPACITY);
+        mpmcQueueInit(&mpmc[i], sizeof(u64), K_BENCH_CAPACITY);
+    }
+
+    if (!benchEmptyBatches(&spsc[0], &mpmc[0]))
+    {
+        printf("Batches of no elements did not return 0\n");
+        return 1;
+    }
+
+    printf("Throughput:\n");
+    benchThroughput("SPSC", &spsc[0], 0, 1, 1);
+    benchThroughput("SPSC", &spsc[0], 0, 1, K_BENCH_BATCH);
+    for (int numPairs = 1; numPairs <= maxPairs; numPairs *= 2)
+    {
+        benchThroughput("MPMC", 0, &mpmc[0], numPairs, 1);
+        benchThroughput("MPMC", 0, &mpmc[0], numPairs, K_BENCH_BATCH);
+    }
+
+    printf("Latency (one way):\n");
+    benchLatency("SPSC", spsc, 0);
+    benchLatency("MPMC", 0, mpmc);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        spscQueueDone(&spsc[i]);
+        mpmcQueueDone(&mpmc[i]);
+    }
+
+    return 0;
+}
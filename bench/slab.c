@@ -0,0 +1,119 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Slab allocator benchmark
+// Compares K_ALLOC/K_FREE going through the size-class slab allocator with the C runtime's malloc and free.  Each
+// thread keeps K_BENCH_LIVE blocks alive and replaces a random one at a time with a block from a size mix that is
+// mostly small with a tail of larger blocks, touching each block it allocates.  The runs go from one thread up to
+// every processor.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_IMPLEMENTATION
+#define K_MEMORY_SLAB YES
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+#include <kore/k_random.h>
+
+#include "bench.h"
+
+#define K_BENCH_OPS     4000000
+#define K_BENCH_LIVE    4096
+
+typedef struct
+{
+    i32*    sizes;          // Size of each allocation.
+    i32*    slots;          // Slot each allocation replaces.
+    bool    useSlab;
+}
+BenchSlabThread;
+
+// Pick a size: 60% up to 64 bytes, 30% up to 512 bytes, 9% up to 4KB and 1% up to 64KB.
+internal i32 benchSlabSize(Random* r)
+{
+    u64 x = random64(r);
+    i32 pick = (i32)(x % 100);
+    i32 limit = pick < 60 ? 64 : pick < 90 ? 512 : pick < 99 ? KB(4) : KB(64);
+
+    return 1 + (i32)((x >> 8) % (u64)limit);
+}
+
+internal void benchSlabThread(void* context)
+{
+    BenchSlabThread* thread = (BenchSlabThread *)context;
+    u8* blocks[K_BENCH_LIVE] = { 0 };
+    i32 sizes[K_BENCH_LIVE] = { 0 };
+
+    for (i64 i = 0; i < K_BENCH_OPS; ++i)
+    {
+        i32 slot = thread->slots[i];
+        i32 size = thread->sizes[i];
+
+        if (thread->useSlab)
+        {
+            if (blocks[slot]) K_FREE(blocks[slot], sizes[slot]);
+            blocks[slot] = (u8 *)K_ALLOC(size);
+        }
+        else
+        {
+            free(blocks[slot]);
+            blocks[slot] = (u8 *)malloc(size);
+        }
+        blocks[slot][0] = (u8)i;
+        sizes[slot] = size;
+    }
+
+    for (i64 i = 0; i < K_BENCH_LIVE; ++i)
+    {
+        if (thread->useSlab)
+        {
+            if (blocks[i]) K_FREE(blocks[i], sizes[i]);
+        }
+        else
+        {
+            free(blocks[i]);
+        }
+    }
+
+    if (thread->useSlab) memoryThreadDone();
+}
+
+int kmain(int argc, char** argv)
+{
+    int maxThreads = K_MIN(benchNumProcessors(), K_BENCH_MAX_THREADS);
+    BenchSlabThread threads[K_BENCH_MAX_THREADS];
+    Random r;
+
+    randomInitSeed(&r, 1234);
+    for (int i = 0; i < maxThreads; ++i)
+    {
+        threads[i].sizes = (i32 *)malloc(sizeof(i32) * K_BENCH_OPS);
+        threads[i].slots = (i32 *)malloc(sizeof(i32) * K_BENCH_OPS);
+        for (i64 j = 0; j < K_BENCH_OPS; ++j)
+        {
+            threads[i].sizes[j] = benchSlabSize(&r);
+            threads[i].slots[j] = (i32)(random64(&r) % K_BENCH_LIVE);
+        }
+    }
+
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+    {
+        for (int slab = 0; slab < 2; ++slab)
+        {
+            char name[64];
+
+            for (int i = 0; i < numThreads; ++i) threads[i].useSlab = (bool)slab;
+            snprintf(name, sizeof(name), "%s, %d thread%s", slab ? "slab" : "malloc", numThreads,
+                numThreads == 1 ? "" : "s");
+            benchReport(name, benchRunThreads(numThreads, benchSlabThread, threads, sizeof(threads[0])),
+                (i64)K_BENCH_OPS * numThreads);
+        }
+
+        if (numThreads < maxThreads && numThreads * 2 > maxThreads) numThreads = maxThreads / 2;
+    }
+
+    for (int i = 0; i < maxThreads; ++i)
+    {
+        free(threads[i].sizes);
+        free(threads[i].slots);
+    }
+
+    return 0;
+}
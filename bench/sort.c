@@ -0,0 +1,206 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Sort benchmark
+// Compares the radix sorts with qsort and std::sort on random u32, u64 and f32 keys and on u32 key-value pairs, for
+// run lengths from 16 keys (the sorting network) up to 16M.  Every run sorts K_BENCH_TOTAL keys in all, as one
+// array or as many separate runs, so the times for different lengths are comparable.  Build with sort_std.cpp.
+//
+// std::sort sorts the pairs as an array of structs, which is how it would be used; the radix sort takes separate key
+// and value arrays.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_IMPLEMENTATION
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+#include <kore/k_sort.h>
+#include <kore/k_random.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define K_BENCH_TOTAL   (16 * 1024 * 1024)
+
+typedef struct
+{
+    u32     key;
+    u32     value;
+}
+BenchPair;
+
+// Implemented in sort_std.cpp
+void benchStdSortU32(u32* keys, i64 count);
+void benchStdSortU64(u64* keys, i64 count);
+void benchStdSortF32(f32* keys, i64 count);
+void benchStdSortPairs(void* pairs, i64 count);
+
+internal int benchCompareU32(const void* a, const void* b)
+{
+    u32 x = *(const u32 *)a;
+    u32 y = *(const u32 *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+internal int benchCompareU64(const void* a, const void* b)
+{
+    u64 x = *(const u64 *)a;
+    u64 y = *(const u64 *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+internal int benchCompareF32(const void* a, const void* b)
+{
+    f32 x = *(const f32 *)a;
+    f32 y = *(const f32 *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Data to sort and a master copy to restore it from before each sort
+typedef struct
+{
+    u32*        u32Keys;
+    u64*        u64Keys;
+    f32*        f32Keys;
+    u32*        values;
+    BenchPair*  pairs;
+    u32*        u32Master;
+    u64*        u64Master;
+    f32*        f32Master;
+}
+BenchData;
+
+internal void benchRestore(BenchData* d)
+{
+    memoryCopy(d->u32Master, d->u32Keys, sizeof(u32) * K_BENCH_TOTAL);
+    memoryCopy(d->u64Master, d->u64Keys, sizeof(u64) * K_BENCH_TOTAL);
+    memoryCopy(d->f32Master, d->f32Keys, sizeof(f32) * K_BENCH_TOTAL);
+    for (i64 i = 0; i < K_BENCH_TOTAL; ++i)
+    {
+        d->values[i] = (u32)i;
+        d->pairs[i].key = d->u32Master[i];
+        d->pairs[i].value = (u32)i;
+    }
+}
+
+// Check that every run of a sort is in order.
+internal bool benchSorted(BenchData* d, int which, i64 runLength)
+{
+    for (i64 i = 1; i < K_BENCH_TOTAL; ++i)
+    {
+        if (i % runLength == 0) continue;
+        switch (which)
+        {
+        case 0: if (d->u32Keys[i - 1] > d->u32Keys[i]) return NO; break;
+        case 1: if (d->u64Keys[i - 1] > d->u64Keys[i]) return NO; break;
+        case 2: if (d->f32Keys[i - 1] > d->f32Keys[i]) return NO; break;
+        case 3: if (d->pairs[i - 1].key > d->pairs[i].key) return NO; break;
+        }
+    }
+    return YES;
+}
+
+// Kinds of key, in the order of the checks in benchSorted
+#define K_BENCH_U32     0
+#define K_BENCH_U64     1
+#define K_BENCH_F32     2
+#define K_BENCH_PAIRS   3
+
+// Ways of sorting
+#define K_BENCH_RADIX       0
+#define K_BENCH_IN_PLACE    1
+#define K_BENCH_QSORT       2
+#define K_BENCH_STD         3
+
+internal void benchSortRun(BenchData* d, int kind, int method, i64 i, i64 n)
+{
+    switch (kind * 4 + method)
+    {
+    case K_BENCH_U32 * 4 + K_BENCH_RADIX:       sortU32(d->u32Keys + i, n); break;
+    case K_BENCH_U32 * 4 + K_BENCH_IN_PLACE:    sortU32InPlace(d->u32Keys + i, n); break;
+    case K_BENCH_U32 * 4 + K_BENCH_QSORT:       qsort(d->u32Keys + i, (size_t)n, sizeof(u32), benchCompareU32); break;
+    case K_BENCH_U32 * 4 + K_BENCH_STD:         benchStdSortU32(d->u32Keys + i, n); break;
+
+    case K_BENCH_U64 * 4 + K_BENCH_RADIX:       sortU64(d->u64Keys + i, n); break;
+    case K_BENCH_U64 * 4 + K_BENCH_IN_PLACE:    sortU64InPlace(d->u64Keys + i, n); break;
+    case K_BENCH_U64 * 4 + K_BENCH_QSORT:       qsort(d->u64Keys + i, (size_t)n, sizeof(u64), benchCompareU64); break;
+    case K_BENCH_U64 * 4 + K_BENCH_STD:         benchStdSortU64(d->u64Keys + i, n); break;
+
+    case K_BENCH_F32 * 4 + K_BENCH_RADIX:       sortF32(d->f32Keys + i, n); break;
+    case K_BENCH_F32 * 4 + K_BENCH_QSORT:       qsort(d->f32Keys + i, (size_t)n, sizeof(f32), benchCompareF32); break;
+    case K_BENCH_F32 * 4 + K_BENCH_STD:         benchStdSortF32(d->f32Keys + i, n); break;
+
+    case K_BENCH_PAIRS * 4 + K_BENCH_RADIX:
+        sortU32Pairs(d->u32Keys + i, d->values + i, n);
+        break;
+    case K_BENCH_PAIRS * 4 + K_BENCH_QSORT:
+        qsort(d->pairs + i, (size_t)n, sizeof(BenchPair), benchCompareU32);
+        break;
+    case K_BENCH_PAIRS * 4 + K_BENCH_STD:
+        benchStdSortPairs(d->pairs + i, n);
+        break;
+    }
+}
+
+int kmain(int argc, char** argv)
+{
+    static const char* kinds[] = { "u32", "u64", "f32", "u32 pairs" };
+    static const char* methods[] = { "radix", "radix in place", "qsort", "std::sort" };
+    BenchData d;
+    Random r;
+
+    d.u32Keys = (u32 *)K_ALLOC(sizeof(u32) * K_BENCH_TOTAL);
+    d.u64Keys = (u64 *)K_ALLOC(sizeof(u64) * K_BENCH_TOTAL);
+    d.f32Keys = (f32 *)K_ALLOC(sizeof(f32) * K_BENCH_TOTAL);
+    d.values = (u32 *)K_ALLOC(sizeof(u32) * K_BENCH_TOTAL);
+    d.pairs = (BenchPair *)K_ALLOC(sizeof(BenchPair) * K_BENCH_TOTAL);
+    d.u32Master = (u32 *)K_ALLOC(sizeof(u32) * K_BENCH_TOTAL);
+    d.u64Master = (u64 *)K_ALLOC(sizeof(u64) * K_BENCH_TOTAL);
+    d.f32Master = (f32 *)K_ALLOC(sizeof(f32) * K_BENCH_TOTAL);
+
+    randomInitSeed(&r, 1234);
+    for (i64 i = 0; i < K_BENCH_TOTAL; ++i)
+    {
+        u64 x = random64(&r);
+        d.u32Master[i] = (u32)x;
+        d.u64Master[i] = x;
+        d.f32Master[i] = (f32)(randomFloat(&r) * 2.0 - 1.0) * 1e6f;
+    }
+
+    for (i64 runLength = 16; runLength <= K_BENCH_TOTAL; runLength *= 16)
+    {
+        printf("Runs of %lld keys:\n", runLength);
+        for (int kind = 0; kind < 4; ++kind)
+        {
+            for (int method = 0; method < 4; ++method)
+            {
+                char label[64];
+                Time t;
+
+                // There are no in-place sorts for floats or pairs
+                if (method == K_BENCH_IN_PLACE && kind >= K_BENCH_F32) continue;
+
+                benchRestore(&d);
+                timerStart(&t);
+                for (i64 i = 0; i < K_BENCH_TOTAL; i += runLength) benchSortRun(&d, kind, method, i, runLength);
+                snprintf(label, sizeof(label), "    %s, %s", kinds[kind], methods[method]);
+                benchReport(label, timerEnd(&t), K_BENCH_TOTAL);
+
+                // The radix pair sort sorts the key array rather than the array of pairs
+                if (!benchSorted(&d, kind == K_BENCH_PAIRS && method == K_BENCH_RADIX ? K_BENCH_U32 : kind,
+                    runLength))
+                {
+                    printf("    not sorted!\n");
+                }
+            }
+        }
+    }
+
+    K_FREE(d.u32Keys, sizeof(u32) * K_BENCH_TOTAL);
+    K_FREE(d.u64Keys, sizeof(u64) * K_BENCH_TOTAL);
+    K_FREE(d.f32Keys, sizeof(f32) * K_BENCH_TOTAL);
+    K_FREE(d.values, sizeof(u32) * K_BENCH_TOTAL);
+    K_FREE(d.pairs, sizeof(BenchPair) * K_BENCH_TOTAL);
+    K_FREE(d.u32Master, sizeof(u32) * K_BENCH_TOTAL);
+    K_FREE(d.u64Master, sizeof(u64) * K_BENCH_TOTAL);
+    K_FREE(d.f32Master, sizeof(f32) * K_BENCH_TOTAL);
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+//----------------------------------------------------------------------------------------------------------------------
+// std::sort for the sort benchmark
+// The kore headers are C, so std::sort is wrapped here and linked with sort.c:
+//
+//      cl /O2 /I<directory containing kore> sort.c sort_std.cpp
+//----------------------------------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <stdint.h>
+
+struct BenchPair
+{
+    uint32_t    key;
+    uint32_t    value;
+};
+
+extern "C" void benchStdSortU32(uint32_t* keys, int64_t count)
+{
+    std::sort(keys, keys + count);
+}
+
+extern "C" void benchStdSortU64(uint64_t* keys, int64_t count)
+{
+    std::sort(keys, keys + count);
+}
+
+extern "C" void benchStdSortF32(float* keys, int64_t count)
+{
+    std::sort(keys, keys + count);
+}
+
+extern "C" void benchStdSortPairs(void* pairs, int64_t count)
+{
+    BenchPair* p = (BenchPair *)pairs;
+    std::sort(p, p + count, [](const BenchPair& a, const BenchPair& b) { return a.key < b.key; });
+}
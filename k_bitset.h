@@ -0,0 +1,462 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Bitset API
+// A resizable set of bits stored in an Array of u64 words.
+//
+// The words are 32-byte aligned and padded to a multiple of 256 bits so the bulk operations can work on whole AVX2
+// registers without a scalar tail.  Bits past the end of the set are always zero.  The bulk operations use AVX2 when
+// the CPU supports it and plain 64-bit operations otherwise.
+//
+// Iterate over set bits like this:
+//
+//      for (i64 i = bitsetFindNext(&bits, 0); i >= 0; i = bitsetFindNext(&bits, i + 1)) { ... }
+//
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+
+typedef struct
+{
+    Array(u64)  words;
+    i64         numBits;
+}
+Bitset;
+
+// Initialise a bitset with all bits clear.  Returns NO if memory could not be allocated, leaving the bitset empty.
+bool bitsetInit(Bitset* bits, i64 numBits);
+
+// Release the bitset's memory.
+void bitsetDone(Bitset* bits);
+
+// Change the number of bits.  New bits are clear.  Returns NO if memory could not be allocated, leaving the bitset
+// as it was.
+bool bitsetResize(Bitset* bits, i64 numBits);
+
+// Number of bits in the set.
+i64 bitsetSize(const Bitset* bits);
+
+// Single bit access
+void bitsetSet(Bitset* bits, i64 i);
+void bitsetClear(Bitset* bits, i64 i);
+bool bitsetTest(const Bitset* bits, i64 i);
+
+// Set or clear the bits from start up to, but not including, end.
+void bitsetSetRange(Bitset* bits, i64 start, i64 end);
+void bitsetClearRange(Bitset* bits, i64 start, i64 end);
+
+// Set or clear every bit.
+void bitsetSetAll(Bitset* bits);
+void bitsetClearAll(Bitset* bits);
+
+// Combine src into dst.  Both must be the same size.
+void bitsetAnd(Bitset* dst, const Bitset* src);
+void bitsetOr(Bitset* dst, const Bitset* src);
+void bitsetXor(Bitset* dst, const Bitset* src);
+void bitsetAndNot(Bitset* dst, const Bitset* src);      // dst = dst & ~src
+
+// Number of set bits.
+i64 bitsetCount(const Bitset* bits);
+
+// Index of the first set bit at or after start, or -1 if there are none.
+i64 bitsetFindNext(const Bitset* bits, i64 start);
+
+// Index of the first set bit, or -1 if there are none.
+i64 bitsetFindFirst(const Bitset* bits);
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#ifdef K_IMPLEMENTATION
+
+#if COMPILER_MSVC
+#   include <intrin.h>
+#endif
+
+#if CPU_X86 || CPU_X64
+#   include <immintrin.h>
+#endif
+
+#define K_BITSET_WORD(i) ((i) >> 6)
+#define K_BITSET_MASK(i) ((u64)1 << ((i) & 63))
+
+internal i64 __bitsetNumWords(i64 numBits)
+{
+    return (numBits + 255) / 256 * 4;
+}
+
+// Clear the unused bits in the last word so they never show up in counts or searches.
+internal void __bitsetTrim(Bitset* bits)
+{
+    i64 used = bits->numBits & 63;
+    if (used)
+    {
+        bits->words[K_BITSET_WORD(bits->numBits)] &= ((u64)1 << used) - 1;
+    }
+}
+
+internal i64 __bitsetPopCount(u64 x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (i64)((x * 0x0101010101010101ull) >> 56);
+}
+
+internal i64 __bitsetFirstBit(u64 x)
+{
+    unsigned long index;
+#if CPU_X64
+    _BitScanForward64(&index, x);
+#else
+    // _BitScanForward64 only exists on 64-bit CPUs so scan the halves.
+    if (_BitScanForward(&index, (u32)x)) return (i64)index;
+    _BitScanForward(&index, (u32)(x >> 32));
+    index += 32;
+#endif
+    return (i64)index;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// AVX2 support
+//----------------------------------------------------------------------------------------------------------------------
+
+#if CPU_X86 || CPU_X64
+
+internal bool __bitsetUseAvx2()
+{
+    return K_BOOL(__memoryCpuFeatures() & K_MEMORY_CPU_AVX2);
+}
+
+// Count the bits in a multiple of 4 words using a nibble lookup table per byte and summing the bytes with SAD.
+internal i64 __bitsetCountAvx2(const u64* words, i64 numWords)
+{
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    u64 lanes[4];
+
+    for (i64 i = 0; i < numWords; i += 4)
+    {
+        __m256i v = _mm256_load_si256((const __m256i *)(words + i));
+        __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low));
+        __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+    }
+
+    // _mm256_extract_epi64 only exists on 64-bit CPUs so store the lanes and add them instead.
+    _mm256_storeu_si256((__m256i *)lanes, total);
+    _mm256_zeroupper();
+
+    return (i64)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+#else
+
+internal bool __bitsetUseAvx2()
+{
+    return NO;
+}
+
+#endif // CPU_X86 || CPU_X64
+
+//----------------------------------------------------------------------------------------------------------------------
+// Public API
+//----------------------------------------------------------------------------------------------------------------------
+
+bool bitsetInit(Bitset* bits, i64 numBits)
+{
+    bits->words = 0;
+    bits->numBits = 0;
+    return bitsetResize(bits, numBits);
+}
+
+void bitsetDone(Bitset* bits)
+{
+    arrayRelease(bits->words);
+    bits->words = 0;
+    bits->numBits = 0;
+}
+
+bool bitsetResize(Bitset* bits, i64 numBits)
+{
+    i64 numWords = __bitsetNumWords(numBits);
+    i64 oldWords = arrayCount(bits->words);
+
+    if (numWords > oldWords)
+    {
+        // Grow a copy of the pointer, so that the words are not lost if the allocation fails.  Arrays grow when they
+        // become full, so reserve one more word than is needed to allocate only once.
+        Array(u64) words = bits->words;
+        u64* p;
+
+        if (!words)
+        {
+            arrayReserveAligned(words, numWords + 1, 32);
+        }
+        else
+        {
+            arrayReserve(words, numWords - oldWords + 1);
+        }
+        if (!words) return NO;
+
+        bits->words = words;
+        p = arrayExpand(bits->words, numWords - oldWords);
+        memoryClear(p, (numWords - oldWords) * sizeof(u64));
+    }
+    else if (bits->words)
+    {
+        __arrayCount(bits->words) = numWords;
+    }
+
+    bits->numBits = numBits;
+    if (numWords)
+    {
+        // Clear any bits left over from a larger size
+        i64 usedWords = (numBits + 63) / 64;
+        memoryClear(&bits->words[usedWords], (numWords - usedWords) * sizeof(u64));
+        __bitsetTrim(bits);
+    }
+
+    return YES;
+}
+
+i64 bitsetSize(const Bitset* bits)
+{
+    return bits->numBits;
+}
+
+void bitsetSet(Bitset* bits, i64 i)
+{
+    K_ASSERT(i >= 0 && i < bits->numBits, "Bit index out of range");
+    bits->words[K_BITSET_WORD(i)] |= K_BITSET_MASK(i);
+}
+
+void bitsetClear(Bitset* bits, i64 i)
+{
+    K_ASSERT(i >= 0 && i < bits->numBits, "Bit index out of range");
+    bits->words[K_BITSET_WORD(i)] &= ~K_BITSET_MASK(i);
+}
+
+bool bitsetTest(const Bitset* bits, i64 i)
+{
+    K_ASSERT(i >= 0 && i < bits->numBits, "Bit index out of range");
+    return K_BOOL(bits->words[K_BITSET_WORD(i)] & K_BITSET_MASK(i));
+}
+
+void bitsetSetRange(Bitset* bits, i64 start, i64 end)
+{
+    i64 first = K_BITSET_WORD(start);
+    i64 last = K_BITSET_WORD(end - 1);
+    u64 firstMask = ~(u64)0 << (start & 63);
+    u64 lastMask = ~(u64)0 >> (63 - ((end - 1) & 63));
+
+    K_ASSERT(start >= 0 && end <= bits->numBits, "Bit range is outside the bitset");
+    if (start >= end) return;
+
+    if (first == last)
+    {
+        bits->words[first] |= firstMask & lastMask;
+    }
+    else
+    {
+        bits->words[first] |= firstMask;
+        for (i64 w = first + 1; w < last; ++w) bits->words[w] = ~(u64)0;
+        bits->words[last] |= lastMask;
+    }
+}
+
+void bitsetClearRange(Bitset* bits, i64 start, i64 end)
+{
+    i64 first = K_BITSET_WORD(start);
+    i64 last = K_BITSET_WORD(end - 1);
+    u64 firstMask = ~(u64)0 << (start & 63);
+    u64 lastMask = ~(u64)0 >> (63 - ((end - 1) & 63));
+
+    K_ASSERT(start >= 0 && end <= bits->numBits, "Bit range is outside the bitset");
+    if (start >= end) return;
+
+    if (first == last)
+    {
+        bits->words[first] &= ~(firstMask & lastMask);
+    }
+    else
+    {
+        bits->words[first] &= ~firstMask;
+        memoryClear(&bits->words[first + 1], (last - first - 1) * sizeof(u64));
+        bits->words[last] &= ~lastMask;
+    }
+}
+
+void bitsetSetAll(Bitset* bits)
+{
+    bitsetSetRange(bits, 0, bits->numBits);
+}
+
+void bitsetClearAll(Bitset* bits)
+{
+    memoryClear(bits->words, arrayCount(bits->words) * sizeof(u64));
+}
+
+#define K_BITSET_AND    0
+#define K_BITSET_OR     1
+#define K_BITSET_XOR    2
+#define K_BITSET_ANDNOT 3
+
+internal void __bitsetCombine(Bitset* dst, const Bitset* src, int op)
+{
+    u64* d = dst->words;
+    const u64* s = src->words;
+    i64 numWords = arrayCount(dst->words);
+
+    K_ASSERT(dst->numBits == src->numBits, "Bitsets must be the same size");
+
+#if CPU_X86 || CPU_X64
+    if (__bitsetUseAvx2())
+    {
+        // Each loop handles 256 bits at a time.  The padding means there is never a partial register.
+        switch (op)
+        {
+        case K_BITSET_AND:
+            for (i64 i = 0; i < numWords; i += 4)
+            {
+                __m256i a = _mm256_load_si256((const __m256i *)(d + i));
+                _mm256_store_si256((__m256i *)(d + i), _mm256_and_si256(a, _mm256_load_si256((const __m256i *)(s + i))));
+            }
+            break;
+
+        case K_BITSET_OR:
+            for (i64 i = 0; i < numWords; i += 4)
+            {
+                __m256i a = _mm256_load_si256((const __m256i *)(d + i));
+                _mm256_store_si256((__m256i *)(d + i), _mm256_or_si256(a, _mm256_load_si256((const __m256i *)(s + i))));
+            }
+            break;
+
+        case K_BITSET_XOR:
+            for (i64 i = 0; i < numWords; i += 4)
+            {
+                __m256i a = _mm256_load_si256((const __m256i *)(d + i));
+                _mm256_store_si256((__m256i *)(d + i), _mm256_xor_si256(a, _mm256_load_si256((const __m256i *)(s + i))));
+            }
+            break;
+
+        case K_BITSET_ANDNOT:
+            // _mm256_andnot_si256 inverts its first operand
+            for (i64 i = 0; i < numWords; i += 4)
+            {
+                __m256i a = _mm256_load_si256((const __m256i *)(d + i));
+                _mm256_store_si256((__m256i *)(d + i), _mm256_andnot_si256(_mm256_load_si256((const __m256i *)(s + i)), a));
+            }
+            break;
+        }
+
+        _mm256_zeroupper();
+        return;
+    }
+#endif
+
+    switch (op)
+    {
+    case K_BITSET_AND:      for (i64 i = 0; i < numWords; ++i) d[i] &= s[i];    break;
+    case K_BITSET_OR:       for (i64 i = 0; i < numWords; ++i) d[i] |= s[i];    break;
+    case K_BITSET_XOR:      for (i64 i = 0; i < numWords; ++i) d[i] ^= s[i];    break;
+    case K_BITSET_ANDNOT:   for (i64 i = 0; i < numWords; ++i) d[i] &= ~s[i];   break;
+    }
+}
+
+void bitsetAnd(Bitset* dst, const Bitset* src)
+{
+    __bitsetCombine(dst, src, K_BITSET_AND);
+}
+
+void bitsetOr(Bitset* dst, const Bitset* src)
+{
+    __bitsetCombine(dst, src, K_BITSET_OR);
+}
+
+void bitsetXor(Bitset* dst, const Bitset* src)
+{
+    __bitsetCombine(dst, src, K_BITSET_XOR);
+}
+
+void bitsetAndNot(Bitset* dst, const Bitset* src)
+{
+    __bitsetCombine(dst, src, K_BITSET_ANDNOT);
+}
+
+i64 bitsetCount(const Bitset* bits)
+{
+    i64 numWords = arrayCount(bits->words);
+    i64 count = 0;
+
+#if CPU_X86 || CPU_X64
+    if (__bitsetUseAvx2()) return __bitsetCountAvx2(bits->words, numWords);
+#endif
+
+    for (i64 i = 0; i < numWords; ++i) count += __bitsetPopCount(bits->words[i]);
+    return count;
+}
+
+i64 bitsetFindNext(const Bitset* bits, i64 start)
+{
+    i64 numWords = arrayCount(bits->words);
+    i64 w;
+    u64 word;
+
+    if (start < 0) start = 0;
+    if (start >= bits->numBits) return -1;
+    w = K_BITSET_WORD(start);
+
+    // Check the rest of the starting word
+    word = bits->words[w] & (~(u64)0 << (start & 63));
+    if (word) return w * 64 + __bitsetFirstBit(word);
+
+    // Scan the words up to the next 256-bit boundary one at a time
+    for (++w; w < numWords && (w & 3); ++w)
+    {
+        if (bits->words[w]) return w * 64 + __bitsetFirstBit(bits->words[w]);
+    }
+
+#if CPU_X86 || CPU_X64
+    // Skip empty 256-bit blocks
+    if (__bitsetUseAvx2())
+    {
+        for (; w < numWords; w += 4)
+        {
+            __m256i v = _mm256_load_si256((const __m256i *)(bits->words + w));
+            if (!_mm256_testz_si256(v, v)) break;
+        }
+        _mm256_zeroupper();
+    }
+#endif
+
+    for (; w < numWords; ++w)
+    {
+        if (bits->words[w]) return w * 64 + __bitsetFirstBit(bits->words[w]);
+    }
+
+    return -1;
+}
+
+i64 bitsetFindFirst(const Bitset* bits)
+{
+    return bitsetFindNext(bits, 0);
+}
+
+#undef K_BITSET_AND
+#undef K_BITSET_OR
+#undef K_BITSET_XOR
+#undef K_BITSET_ANDNOT
+#undef K_BITSET_WORD
+#undef K_BITSET_MASK
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#endif // K_IMPLEMENTATION
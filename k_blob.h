@@ -6,6 +6,7 @@
 #pragma once
 
 #include <kore/k_platform.h>
+#include <kore/k_memory.h>
 
 #if !OS_WIN32
 #   error Not implemented for your OS.
@@ -31,8 +32,31 @@ Blob;
 Blob blobLoad(const char* fileName);
 void blobUnload(Blob data);
 
+// Map a file copy-on-write.  The blob can be written to but the changes are private and never reach the file.
+Blob blobLoadCopy(const char* fileName);
+
 Blob blobMake(const char* fileName, i64 size);
 
+//----------------------------------------------------------------------------------------------------------------------
+// Arena persistence
+// An arena can be written to a file and mapped back later instead of being rebuilt.  Only the allocated part of the
+// arena is saved.  Anything inside the arena that refers to other parts of it must use offsets from start rather
+// than pointers, as the StringTable does, because the arena will be mapped at a different address.
+//
+// A loaded arena is a fixed-size K_ARENA_MAPPED arena with no free space.  It must not be allocated from, pushed or
+// popped.  A copy-on-write arena's contents can be modified but the changes never reach the file.  Release it with
+// arenaDone.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_ARENA_LOAD_READ_ONLY      0
+#define K_ARENA_LOAD_COPY_ON_WRITE  1
+
+// Write the allocated part of an arena to a file.  Returns NO if the file could not be written.
+bool arenaSave(const Arena* arena, const char* fileName);
+
+// Map an arena saved with arenaSave.  Returns NO if the file could not be loaded or is not a saved arena.
+bool arenaLoad(Arena* arena, const char* fileName, int mode);
+
 //----------------------------------------------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------------------------------------------
@@ -42,31 +66,46 @@ Blob blobMake(const char* fileName, i64 size);
 
 #if OS_WIN32
 
-Blob blobLoad(const char* fileName)
+internal Blob __blobLoad(const char* fileName, DWORD protect, DWORD access)
 {
     Blob b = { 0 };
 
     b.file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
-    if (b.file)
+    if (b.file != INVALID_HANDLE_VALUE)
     {
         DWORD fileSizeHigh, fileSizeLow;
         fileSizeLow = GetFileSize(b.file, &fileSizeHigh);
-        b.fileMap = CreateFileMappingA(b.file, 0, PAGE_READONLY, fileSizeHigh, fileSizeLow, 0);
+        b.fileMap = CreateFileMappingA(b.file, 0, protect, fileSizeHigh, fileSizeLow, 0);
 
         if (b.fileMap)
         {
-            b.bytes = MapViewOfFile(b.fileMap, FILE_MAP_READ, 0, 0, 0);
+            b.bytes = MapViewOfFile(b.fileMap, access, 0, 0, 0);
             b.size = ((i64)fileSizeHigh << 32) | fileSizeLow;
         }
         else
         {
             blobUnload(b);
+            b.file = 0;
         }
     }
+    else
+    {
+        b.file = 0;
+    }
 
     return b;
 }
 
+Blob blobLoad(const char* fileName)
+{
+    return __blobLoad(fileName, PAGE_READONLY, FILE_MAP_READ);
+}
+
+Blob blobLoadCopy(const char* fileName)
+{
+    return __blobLoad(fileName, PAGE_WRITECOPY, FILE_MAP_COPY);
+}
+
 void blobUnload(Blob b)
 {
     if (b.bytes)        UnmapViewOfFile(b.bytes);
@@ -84,7 +123,7 @@ Blob blobMake(const char* fileName, i64 size)
     Blob b = { 0 };
 
     b.file = CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS, 0, 0);
-    if (b.file)
+    if (b.file != INVALID_HANDLE_VALUE)
     {
         DWORD fileSizeLow = (size & 0xffffffff);
         DWORD fileSizeHigh = (size >> 32);
@@ -98,12 +137,84 @@ Blob blobMake(const char* fileName, i64 size)
         else
         {
             blobUnload(b);
+            b.file = 0;
         }
     }
+    else
+    {
+        b.file = 0;
+    }
 
     return b;
 }
 
+//----------------------------------------------------------------------------------------------------------------------
+// Arena persistence
+//
+// The file starts with a header padded to a page so the arena's contents keep the same alignment relative to the
+// page size as they had in memory.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_ARENA_FILE_MAGIC 0x314e455241524f4b       // "KORAREN1" in little endian
+
+typedef struct
+{
+    u64     magic;
+    i64     cursor;
+    i64     restore;
+}
+ArenaFileHeader;
+
+bool arenaSave(const Arena* arena, const char* fileName)
+{
+    Blob b = blobMake(fileName, K_PAGE_SIZE + arena->cursor);
+    ArenaFileHeader* header = (ArenaFileHeader *)b.bytes;
+
+    if (!b.bytes)
+    {
+        blobUnload(b);
+        return NO;
+    }
+
+    header->magic = K_ARENA_FILE_MAGIC;
+    header->cursor = arena->cursor;
+    header->restore = arena->restore;
+    memoryCopy(arena->start, b.bytes + K_PAGE_SIZE, arena->cursor);
+    blobUnload(b);
+
+    return YES;
+}
+
+bool arenaLoad(Arena* arena, const char* fileName, int mode)
+{
+    Blob b = mode == K_ARENA_LOAD_COPY_ON_WRITE ? blobLoadCopy(fileName) : blobLoad(fileName);
+    const ArenaFileHeader* header = (const ArenaFileHeader *)b.bytes;
+
+    if (!b.bytes || b.size < K_PAGE_SIZE || header->magic != K_ARENA_FILE_MAGIC ||
+        header->cursor > b.size - K_PAGE_SIZE)
+    {
+        blobUnload(b);
+        return NO;
+    }
+
+    // The view keeps the file mapped after the handles are closed.  arenaDone unmaps it.
+    CloseHandle(b.fileMap);
+    CloseHandle(b.file);
+
+    arena->start = b.bytes + K_PAGE_SIZE;
+    arena->end = arena->start + header->cursor;
+    arena->cursor = header->cursor;
+    arena->restore = header->restore;
+    arena->reserved = header->cursor;
+    arena->kind = K_ARENA_MAPPED;
+    arena->numaNode = K_NUMA_NONE;
+    __arenaStatsInit(arena);
+
+    return YES;
+}
+
+#undef K_ARENA_FILE_MAGIC
+
 #endif
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,818 @@
+//----------------------------------------------------------------------------------------------------------------------
+// B+tree API
+// Ordered map from i64 keys to i64 values.
+//
+// Every node is K_BTREE_NODE_SIZE bytes, a whole number of cache lines, and holds up to K_BTREE_KEYS keys.  Inner
+// nodes hold keys and child pointers; leaves hold keys and values and are linked in key order so range scans walk
+// the leaves without going back up the tree.  The keys in a node are searched 4 at a time with AVX2 when the CPU
+// supports it.
+//
+// Nodes come either from an Arena, aligned to a cache line, or from a Pool shared with other trees.  An arena tree
+// keeps the nodes it frees for reuse and gives its memory back when the arena is popped or destroyed.  A heap arena
+// moves when it grows, so use a virtual arena.  A pool tree returns its nodes to the pool, which must have been
+// created with a slot size of at least sizeof(BTreeNode).
+//
+// Iterate over a range of keys like this:
+//
+//      BTreeIter it = btreeSeek(&tree, low);
+//      BTreeEntry e;
+//      while (btreeNext(&it, &e) && e.key < high) { ... }
+//
+// Pointers and iterators into the tree are only valid until the next call to btreeAdd, btreeRemove or btreeBuild.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+#include <kore/k_pool.h>
+
+// Size of a node in bytes.  Must be a multiple of K_CACHE_LINE_SIZE.
+#ifndef K_BTREE_NODE_SIZE
+#   define K_BTREE_NODE_SIZE   256
+#endif
+
+// Maximum number of keys in a node.  A node needs a 16-byte header and 16 bytes per key.
+#define K_BTREE_KEYS            ((K_BTREE_NODE_SIZE - 16) / 16)
+
+typedef struct BTreeNode
+{
+    i32     count;                                          // Number of keys.
+    i32     leaf;
+    i64     keys[K_BTREE_KEYS];
+    union
+    {
+        struct BTreeNode*   children[K_BTREE_KEYS + 1];     // Inner nodes only.
+        struct
+        {
+            i64                 values[K_BTREE_KEYS];       // Leaves only.
+            struct BTreeNode*   next;
+        };
+    };
+}
+BTreeNode;
+
+typedef struct
+{
+    BTreeNode*  root;
+    BTreeNode*  freeNodes;      // Nodes freed by an arena tree, linked through next.
+    Arena*      arena;
+    Pool*       pool;
+    i64         count;
+    i64         height;         // Number of levels, 0 for an empty tree.
+}
+BTree;
+
+typedef struct
+{
+    i64     key;
+    i64     value;
+}
+BTreeEntry;
+
+typedef struct
+{
+    BTreeNode*  leaf;
+    i64         index;
+}
+BTreeIter;
+
+// Initialise an empty tree with nodes allocated on an arena.
+void btreeInit(BTree* tree, Arena* arena);
+
+// Initialise an empty tree with nodes allocated from a pool.
+void btreeInitPool(BTree* tree, Pool* pool);
+
+// Give the nodes of a pool tree back to the pool.  The memory of an arena tree belongs to the arena.
+void btreeDone(BTree* tree);
+
+// Remove all keys.
+void btreeClear(BTree* tree);
+
+// Number of keys in the tree.
+i64 btreeCount(const BTree* tree);
+
+// Return the value associated with a key, or 0 if the key is not in the tree.
+i64* btreeFind(const BTree* tree, i64 key);
+
+// Add a key and return a pointer to its value.  If the key is new, the value is uninitialised and added is set to YES.
+// The added pointer can be 0.  Returns 0 if a node could not be allocated, leaving the tree unchanged.
+i64* btreeAdd(BTree* tree, i64 key, bool* added);
+
+// Remove a key from the tree.  Returns NO if the key was not in the tree.
+bool btreeRemove(BTree* tree, i64 key);
+
+// Replace the contents of the tree with count entries sorted by key, with no key repeated.  The tree is built bottom
+// up with full leaves, which is much faster than adding the entries one at a time and uses fewer nodes.  Returns NO
+// if a node could not be allocated, leaving the tree empty.
+bool btreeBuild(BTree* tree, const BTreeEntry* entries, i64 count);
+
+// Return an iterator at the first key that is greater than or equal to key.
+BTreeIter btreeSeek(const BTree* tree, i64 key);
+
+// Return an iterator at the smallest key.
+BTreeIter btreeFirst(const BTree* tree);
+
+// Copy the entry at the iterator and move to the next one.  Returns NO when there are no more entries.
+bool btreeNext(BTreeIter* it, BTreeEntry* entry);
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#ifdef K_IMPLEMENTATION
+
+#if COMPILER_MSVC
+#   include <intrin.h>
+#endif
+
+#if CPU_X86 || CPU_X64
+#   include <immintrin.h>
+#endif
+
+// Fewest keys a node other than the root can have.
+#define K_BTREE_MIN_KEYS (K_BTREE_KEYS / 2)
+
+//----------------------------------------------------------------------------------------------------------------------
+// Node search
+//----------------------------------------------------------------------------------------------------------------------
+
+// Number of keys in a node that are less than key, or less than or equal to key if inclusive is set.  This is the
+// position of key in a leaf, or the child to follow in an inner node.
+internal i64 __btreeRankScalar(const BTreeNode* node, i64 start, i64 key, bool inclusive)
+{
+    i64 i = start;
+
+    if (inclusive)
+    {
+        while (i < node->count && node->keys[i] <= key) ++i;
+    }
+    else
+    {
+        while (i < node->count && node->keys[i] < key) ++i;
+    }
+
+    return i;
+}
+
+#if CPU_X86 || CPU_X64
+
+internal bool __btreeUseAvx2()
+{
+    return K_BOOL(__memoryCpuFeatures() & K_MEMORY_CPU_AVX2);
+}
+
+// Compare 4 keys at a time.  Bit i of the mask is set when key i is past the search key; the first set bit is the
+// rank since the keys are sorted.
+internal i64 __btreeRankAvx2(const BTreeNode* node, i64 key, bool inclusive)
+{
+    __m256i k = _mm256_set1_epi64x(key);
+    i64 i = 0;
+
+    for (; i + 4 <= node->count; i += 4)
+    {
+        __m256i keys = _mm256_loadu_si256((const __m256i *)&node->keys[i]);
+        u32 mask = inclusive
+            ? (u32)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(keys, k)))
+            : ~(u32)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, keys))) & 0xf;
+
+        if (mask)
+        {
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return i + (i64)index;
+        }
+    }
+
+    return __btreeRankScalar(node, i, key, inclusive);
+}
+
+#else
+
+internal bool __btreeUseAvx2()
+{
+    return NO;
+}
+
+internal i64 __btreeRankAvx2(const BTreeNode* node, i64 key, bool inclusive)
+{
+    return __btreeRankScalar(node, 0, key, inclusive);
+}
+
+#endif // CPU_X86 || CPU_X64
+
+internal i64 __btreeRank(const BTreeNode* node, i64 key, bool inclusive)
+{
+    return __btreeUseAvx2() ? __btreeRankAvx2(node, key, inclusive) : __btreeRankScalar(node, 0, key, inclusive);
+}
+
+// Find the leaf that key belongs in.
+internal BTreeNode* __btreeFindLeaf(const BTree* tree, i64 key)
+{
+    BTreeNode* node = tree->root;
+
+    while (node && !node->leaf)
+    {
+        node = node->children[__btreeRank(node, key, YES)];
+    }
+
+    return node;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Node allocation
+//----------------------------------------------------------------------------------------------------------------------
+
+internal BTreeNode* __btreeNewNode(BTree* tree, bool leaf)
+{
+    BTreeNode* node = 0;
+
+    if (tree->pool)
+    {
+        node = (BTreeNode *)poolAlloc(tree->pool);
+    }
+    else if (tree->freeNodes)
+    {
+        node = tree->freeNodes;
+        tree->freeNodes = node->next;
+    }
+    else
+    {
+        node = K_ARENA_ALLOC_ALIGNED(tree->arena, BTreeNode, 1, K_CACHE_LINE_SIZE);
+    }
+
+    if (node)
+    {
+        node->count = 0;
+        node->leaf = leaf;
+        node->next = 0;
+    }
+
+    return node;
+}
+
+internal void __btreeFreeNode(BTree* tree, BTreeNode* node)
+{
+    if (tree->pool)
+    {
+        poolFree(tree->pool, node);
+    }
+    else
+    {
+        node->next = tree->freeNodes;
+        tree->freeNodes = node;
+    }
+}
+
+internal void __btreeFreeSubtree(BTree* tree, BTreeNode* node)
+{
+    if (!node->leaf)
+    {
+        for (i64 i = 0; i <= node->count; ++i) __btreeFreeSubtree(tree, node->children[i]);
+    }
+    __btreeFreeNode(tree, node);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Tree control
+//----------------------------------------------------------------------------------------------------------------------
+
+void btreeInit(BTree* tree, Arena* arena)
+{
+    tree->root = 0;
+    tree->freeNodes = 0;
+    tree->arena = arena;
+    tree->pool = 0;
+    tree->count = 0;
+    tree->height = 0;
+}
+
+void btreeInitPool(BTree* tree, Pool* pool)
+{
+    K_ASSERT(pool->slotSize >= (i64)sizeof(BTreeNode), "Pool slots are too small for B+tree nodes");
+
+    btreeInit(tree, 0);
+    tree->pool = pool;
+}
+
+void btreeDone(BTree* tree)
+{
+    if (tree->pool) btreeClear(tree);
+    tree->root = 0;
+    tree->freeNodes = 0;
+    tree->count = 0;
+    tree->height = 0;
+}
+
+void btreeClear(BTree* tree)
+{
+    if (tree->root) __btreeFreeSubtree(tree, tree->root);
+    tree->root = 0;
+    tree->count = 0;
+    tree->height = 0;
+}
+
+i64 btreeCount(const BTree* tree)
+{
+    return tree->count;
+}
+
+i64* btreeFind(const BTree* tree, i64 key)
+{
+    BTreeNode* leaf = __btreeFindLeaf(tree, key);
+    i64 i;
+
+    if (!leaf) return 0;
+
+    i = __btreeRank(leaf, key, NO);
+    return i < leaf->count && leaf->keys[i] == key ? &leaf->values[i] : 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Insertion
+//----------------------------------------------------------------------------------------------------------------------
+
+// Return the number of nodes that adding key would split, plus one for a new root if every node on the way to its
+// leaf is full.
+internal i64 __btreeSplitsNeeded(const BTree* tree, i64 key)
+{
+    BTreeNode* node = tree->root;
+    i64 needed = 0;
+    i64 i;
+
+    while (!node->leaf)
+    {
+        // A node only splits if everything below it on the path does, so a node with room resets the count
+        needed = node->count < K_BTREE_KEYS ? 0 : needed + 1;
+        node = node->children[__btreeRank(node, key, YES)];
+    }
+
+    i = __btreeRank(node, key, NO);
+    if (node->count < K_BTREE_KEYS || (i < node->count && node->keys[i] == key)) return 0;
+
+    ++needed;
+    return needed == tree->height ? needed + 1 : needed;
+}
+
+// Take one of the nodes allocated up front by btreeAdd.
+internal BTreeNode* __btreeTakeNode(BTreeNode** spare, bool leaf)
+{
+    BTreeNode* node = *spare;
+
+    *spare = node->next;
+    node->count = 0;
+    node->leaf = leaf;
+    node->next = 0;
+
+    return node;
+}
+
+// Add a key to the subtree at node and set *value to its value.  If the node had to split, return the new node to
+// its right and set *splitKey to the smallest key under it.  New nodes are taken from spare, which must hold enough
+// for every split.
+internal BTreeNode* __btreeAdd(BTreeNode* node, i64 key, i64** value, bool* added, i64* splitKey, BTreeNode** spare)
+{
+    BTreeNode* right;
+
+    if (node->leaf)
+    {
+        i64 i = __btreeRank(node, key, NO);
+
+        if (i < node->count && node->keys[i] == key)
+        {
+            *value = &node->values[i];
+            return 0;
+        }
+
+        *added = YES;
+        if (node->count < K_BTREE_KEYS)
+        {
+            memoryMove(&node->keys[i], &node->keys[i + 1], (node->count - i) * sizeof(i64));
+            memoryMove(&node->values[i], &node->values[i + 1], (node->count - i) * sizeof(i64));
+            node->keys[i] = key;
+            ++node->count;
+            *value = &node->values[i];
+            return 0;
+        }
+
+        // Split the full leaf in half and add the key to whichever half it belongs in
+        right = __btreeTakeNode(spare, YES);
+
+        right->count = node->count - K_BTREE_KEYS / 2;
+        node->count = K_BTREE_KEYS / 2;
+        memoryCopy(&node->keys[node->count], right->keys, right->count * sizeof(i64));
+        memoryCopy(&node->values[node->count], right->values, right->count * sizeof(i64));
+        right->next = node->next;
+        node->next = right;
+
+        {
+            BTreeNode* half = i <= node->count ? node : right;
+            i64 j = half == node ? i : i - node->count;
+
+            memoryMove(&half->keys[j], &half->keys[j + 1], (half->count - j) * sizeof(i64));
+            memoryMove(&half->values[j], &half->values[j + 1], (half->count - j) * sizeof(i64));
+            half->keys[j] = key;
+            ++half->count;
+            *value = &half->values[j];
+        }
+
+        *splitKey = right->keys[0];
+        return right;
+    }
+    else
+    {
+        i64 i = __btreeRank(node, key, YES);
+        i64 childKey;
+        BTreeNode* child = __btreeAdd(node->children[i], key, value, added, &childKey, spare);
+        i64 keys[K_BTREE_KEYS + 1];
+        BTreeNode* children[K_BTREE_KEYS + 2];
+        i64 mid;
+
+        if (!child) return 0;
+
+        if (node->count < K_BTREE_KEYS)
+        {
+            memoryMove(&node->keys[i], &node->keys[i + 1], (node->count - i) * sizeof(i64));
+            memoryMove(&node->children[i + 1], &node->children[i + 2], (node->count - i) * sizeof(BTreeNode*));
+            node->keys[i] = childKey;
+            node->children[i + 1] = child;
+            ++node->count;
+            return 0;
+        }
+
+        right = __btreeTakeNode(spare, NO);
+
+        // Lay out the overfull node, then move the middle key up and the keys to its right into the new node
+        memoryCopy(node->keys, keys, i * sizeof(i64));
+        keys[i] = childKey;
+        memoryCopy(&node->keys[i], &keys[i + 1], (K_BTREE_KEYS - i) * sizeof(i64));
+        memoryCopy(node->children, children, (i + 1) * sizeof(BTreeNode*));
+        children[i + 1] = child;
+        memoryCopy(&node->children[i + 1], &children[i + 2], (K_BTREE_KEYS - i) * sizeof(BTreeNode*));
+
+        mid = (K_BTREE_KEYS + 1) / 2;
+        node->count = (i32)mid;
+        memoryCopy(keys, node->keys, mid * sizeof(i64));
+        memoryCopy(children, node->children, (mid + 1) * sizeof(BTreeNode*));
+
+        right->count = (i32)(K_BTREE_KEYS - mid);
+        memoryCopy(&keys[mid + 1], right->keys, right->count * sizeof(i64));
+        memoryCopy(&children[mid + 1], right->children, (right->count + 1) * sizeof(BTreeNode*));
+
+        *splitKey = keys[mid];
+        return right;
+    }
+}
+
+i64* btreeAdd(BTree* tree, i64 key, bool* added)
+{
+    i64* value = 0;
+    bool isNew = NO;
+    i64 splitKey;
+    BTreeNode* right;
+    BTreeNode* spare = 0;
+
+    if (!tree->root)
+    {
+        tree->root = __btreeNewNode(tree, YES);
+        if (!tree->root) return 0;
+        tree->height = 1;
+    }
+
+    // Allocate the nodes for any splits before touching the tree, so that running out of memory leaves it intact
+    for (i64 needed = __btreeSplitsNeeded(tree, key); needed > 0; --needed)
+    {
+        BTreeNode* node = __btreeNewNode(tree, NO);
+
+        if (!node)
+        {
+            while (spare)
+            {
+                node = spare;
+                spare = spare->next;
+                __btreeFreeNode(tree, node);
+            }
+            if (added) *added = NO;
+            return 0;
+        }
+        node->next = spare;
+        spare = node;
+    }
+
+    right = __btreeAdd(tree->root, key, &value, &isNew, &splitKey, &spare);
+    if (right)
+    {
+        // The root split so the tree grows a level
+        BTreeNode* root = __btreeTakeNode(&spare, NO);
+        root->count = 1;
+        root->keys[0] = splitKey;
+        root->children[0] = tree->root;
+        root->children[1] = right;
+        tree->root = root;
+        ++tree->height;
+    }
+
+    K_ASSERT(!spare, "Every node allocated for the splits should have been used");
+    if (isNew) ++tree->count;
+    if (added) *added = isNew;
+    return value;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Removal
+//----------------------------------------------------------------------------------------------------------------------
+
+// Move the last entry of child i - 1 of node to the front of child i.
+internal void __btreeBorrowLeft(BTreeNode* node, i64 i)
+{
+    BTreeNode* left = node->children[i - 1];
+    BTreeNode* child = node->children[i];
+
+    memoryMove(child->keys, &child->keys[1], child->count * sizeof(i64));
+    if (child->leaf)
+    {
+        memoryMove(child->values, &child->values[1], child->count * sizeof(i64));
+        child->keys[0] = left->keys[left->count - 1];
+        child->values[0] = left->values[left->count - 1];
+        node->keys[i - 1] = child->keys[0];
+    }
+    else
+    {
+        memoryMove(child->children, &child->children[1], (child->count + 1) * sizeof(BTreeNode*));
+        child->keys[0] = node->keys[i - 1];
+        child->children[0] = left->children[left->count];
+        node->keys[i - 1] = left->keys[left->count - 1];
+    }
+    ++child->count;
+    --left->count;
+}
+
+// Move the first entry of child i + 1 of node to the end of child i.
+internal void __btreeBorrowRight(BTreeNode* node, i64 i)
+{
+    BTreeNode* child = node->children[i];
+    BTreeNode* right = node->children[i + 1];
+
+    if (child->leaf)
+    {
+        child->keys[child->count] = right->keys[0];
+        child->values[child->count] = right->values[0];
+        memoryMove(&right->values[1], right->values, (right->count - 1) * sizeof(i64));
+        memoryMove(&right->keys[1], right->keys, (right->count - 1) * sizeof(i64));
+        node->keys[i] = right->keys[0];
+    }
+    else
+    {
+        child->keys[child->count] = node->keys[i];
+        child->children[child->count + 1] = right->children[0];
+        node->keys[i] = right->keys[0];
+        memoryMove(&right->keys[1], right->keys, (right->count - 1) * sizeof(i64));
+        memoryMove(&right->children[1], right->children, right->count * sizeof(BTreeNode*));
+    }
+    ++child->count;
+    --right->count;
+}
+
+// Merge child i + 1 of node into child i and remove it from node.
+internal void __btreeMerge(BTree* tree, BTreeNode* node, i64 i)
+{
+    BTreeNode* child = node->children[i];
+    BTreeNode* right = node->children[i + 1];
+
+    if (child->leaf)
+    {
+        memoryCopy(right->keys, &child->keys[child->count], right->count * sizeof(i64));
+        memoryCopy(right->values, &child->values[child->count], right->count * sizeof(i64));
+        child->count += right->count;
+        child->next = right->next;
+    }
+    else
+    {
+        // The key that separated the two children comes down between them
+        child->keys[child->count] = node->keys[i];
+        memoryCopy(right->keys, &child->keys[child->count + 1], right->count * sizeof(i64));
+        memoryCopy(right->children, &child->children[child->count + 1], (right->count + 1) * sizeof(BTreeNode*));
+        child->count += right->count + 1;
+    }
+
+    memoryMove(&node->keys[i + 1], &node->keys[i], (node->count - i - 1) * sizeof(i64));
+    memoryMove(&node->children[i + 2], &node->children[i + 1], (node->count - i - 1) * sizeof(BTreeNode*));
+    --node->count;
+
+    __btreeFreeNode(tree, right);
+}
+
+// Remove a key from the subtree at node.  A node that drops below the minimum number of keys is refilled by its
+// parent on the way back up.
+internal bool __btreeRemove(BTree* tree, BTreeNode* node, i64 key)
+{
+    BTreeNode* child;
+    i64 i;
+
+    if (node->leaf)
+    {
+        i = __btreeRank(node, key, NO);
+        if (i >= node->count || node->keys[i] != key) return NO;
+
+        memoryMove(&node->keys[i + 1], &node->keys[i], (node->count - i - 1) * sizeof(i64));
+        memoryMove(&node->values[i + 1], &node->values[i], (node->count - i - 1) * sizeof(i64));
+        --node->count;
+        return YES;
+    }
+
+    i = __btreeRank(node, key, YES);
+    child = node->children[i];
+    if (!__btreeRemove(tree, child, key)) return NO;
+
+    if (child->count < K_BTREE_MIN_KEYS)
+    {
+        if (i > 0 && node->children[i - 1]->count > K_BTREE_MIN_KEYS)
+        {
+            __btreeBorrowLeft(node, i);
+        }
+        else if (i < node->count && node->children[i + 1]->count > K_BTREE_MIN_KEYS)
+        {
+            __btreeBorrowRight(node, i);
+        }
+        else if (i > 0)
+        {
+            __btreeMerge(tree, node, i - 1);
+        }
+        else
+        {
+            __btreeMerge(tree, node, i);
+        }
+    }
+
+    return YES;
+}
+
+bool btreeRemove(BTree* tree, i64 key)
+{
+    BTreeNode* root = tree->root;
+
+    if (!root || !__btreeRemove(tree, root, key)) return NO;
+
+    --tree->count;
+    if (root->count == 0)
+    {
+        // An empty inner root has a single child that takes its place
+        tree->root = root->leaf ? 0 : root->children[0];
+        --tree->height;
+        __btreeFreeNode(tree, root);
+    }
+
+    return YES;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Bulk loading
+//----------------------------------------------------------------------------------------------------------------------
+
+typedef struct
+{
+    BTreeNode*  node;
+    i64         minKey;     // Smallest key under the node.
+}
+BTreeBuildNode;
+
+bool btreeBuild(BTree* tree, const BTreeEntry* entries, i64 count)
+{
+    Array(BTreeBuildNode) level = 0;
+    BTreeNode* prev = 0;
+    i64 numNodes;
+
+    btreeClear(tree);
+    if (!count) return YES;
+
+    // Spread the entries evenly over as few leaves as possible, so every leaf has at least the minimum number of keys
+    numNodes = (count + K_BTREE_KEYS - 1) / K_BTREE_KEYS;
+    arrayReserve(level, numNodes);
+    for (i64 n = 0, e = 0; n < numNodes; ++n)
+    {
+        BTreeNode* leaf = __btreeNewNode(tree, YES);
+        i64 num = count / numNodes + (n < count % numNodes ? 1 : 0);
+        BTreeBuildNode b;
+
+        if (!leaf) goto fail;
+
+        for (i64 j = 0; j < num; ++j)
+        {
+            K_ASSERT(e + j == 0 || entries[e + j].key > entries[e + j - 1].key, "Entries must be sorted and unique");
+            leaf->keys[j] = entries[e + j].key;
+            leaf->values[j] = entries[e + j].value;
+        }
+        leaf->count = (i32)num;
+        if (prev) prev->next = leaf;
+        prev = leaf;
+
+        b.node = leaf;
+        b.minKey = leaf->keys[0];
+        arrayAdd(level, b);
+        e += num;
+    }
+    tree->height = 1;
+
+    // Build each level of inner nodes from the one below, in place since each level is smaller
+    while (arrayCount(level) > 1)
+    {
+        i64 numChildren = arrayCount(level);
+        numNodes = (numChildren + K_BTREE_KEYS) / (K_BTREE_KEYS + 1);
+
+        for (i64 n = 0, c = 0; n < numNodes; ++n)
+        {
+            BTreeNode* node = __btreeNewNode(tree, NO);
+            i64 num = numChildren / numNodes + (n < numChildren % numNodes ? 1 : 0);
+            i64 minKey = level[c].minKey;
+
+            if (!node)
+            {
+                // Keep the nodes that have not been given a parent yet after the new parents
+                memoryMove(&level[c], &level[n], (numChildren - c) * sizeof(BTreeBuildNode));
+                __arrayCount(level) = n + numChildren - c;
+                goto fail;
+            }
+
+            for (i64 j = 0; j < num; ++j)
+            {
+                node->children[j] = level[c + j].node;
+                if (j > 0) node->keys[j - 1] = level[c + j].minKey;
+            }
+            node->count = (i32)(num - 1);
+
+            level[n].node = node;
+            level[n].minKey = minKey;
+            c += num;
+        }
+        __arrayCount(level) = numNodes;
+        ++tree->height;
+    }
+
+    tree->root = level[0].node;
+    tree->count = count;
+    arrayRelease(level);
+    return YES;
+
+fail:
+    // Free the complete subtrees built so far
+    for (i64 i = 0; i < arrayCount(level); ++i) __btreeFreeSubtree(tree, level[i].node);
+    arrayRelease(level);
+    tree->height = 0;
+    return NO;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Iteration
+//----------------------------------------------------------------------------------------------------------------------
+
+BTreeIter btreeSeek(const BTree* tree, i64 key)
+{
+    BTreeIter it;
+
+    it.leaf = __btreeFindLeaf(tree, key);
+    it.index = it.leaf ? __btreeRank(it.leaf, key, NO) : 0;
+
+    return it;
+}
+
+BTreeIter btreeFirst(const BTree* tree)
+{
+    BTreeIter it;
+    BTreeNode* node = tree->root;
+
+    while (node && !node->leaf) node = node->children[0];
+    it.leaf = node;
+    it.index = 0;
+
+    return it;
+}
+
+bool btreeNext(BTreeIter* it, BTreeEntry* entry)
+{
+    while (it->leaf && it->index >= it->leaf->count)
+    {
+        it->leaf = it->leaf->next;
+        it->index = 0;
+
+        // Start fetching the leaf after this one so long scans do not stall at every leaf
+#if CPU_X86 || CPU_X64
+        if (it->leaf && it->leaf->next) _mm_prefetch((const char *)it->leaf->next, _MM_HINT_T0);
+#endif
+    }
+
+    if (!it->leaf) return NO;
+
+    entry->key = it->leaf->keys[it->index];
+    entry->value = it->leaf->values[it->index];
+    ++it->index;
+
+    return YES;
+}
+
+#undef K_BTREE_MIN_KEYS
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#endif // K_IMPLEMENTATION
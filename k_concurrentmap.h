@@ -0,0 +1,596 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Concurrent map API
+// Hash map for tables that are read by many threads and changed rarely.  Lookups never take a lock; writers are
+// serialised by a lock of their own so they never hold readers up.
+//
+// Each slot of the table holds the hash of a key and a pointer to an entry containing the key and value.  Entries
+// are never changed once they are in the table: setting a key's value publishes a new entry in its slot, removing a
+// key replaces the pointer with a tombstone, and growing the table publishes a new table pointing to the same
+// entries.  A reader can therefore always finish a lookup on whatever it saw when it started.
+//
+// Memory that writers take out of the map is reclaimed with epochs.  A reader announces the map's epoch while it is
+// looking a key up.  A writer tags what it takes out with the epoch at the time, moves the epoch on, and only frees
+// memory whose tag is older than every epoch announced by a reader still in a lookup.
+//
+// Threads announce epochs in a slot of their own, claimed the first time they look a key up in any map.  At most
+// K_CONCURRENTMAP_MAX_THREADS threads can have a slot at once, so call concurrentMapThreadDone before a thread that
+// used a concurrent map exits.  A thread that cannot get a slot still works, but its lookups take the writers' lock
+// shared, so they wait for writers.
+//
+// Keys are hashed with hash() and compared bytewise so any padding in a key type must be cleared.  Values are copied
+// out by concurrentMapFind so they stay valid whatever writers do afterwards.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+#include <kore/k_string.h>
+
+// Maximum number of threads that can use concurrent maps at once without taking a lock.  Must be a multiple of 64.
+// Every write scans a slot per thread, so keep this close to the number of threads that read the maps.
+#ifndef K_CONCURRENTMAP_MAX_THREADS
+#   define K_CONCURRENTMAP_MAX_THREADS 64
+#endif
+
+// The table grows when its used and removed slots make it fuller than this percentage.
+#ifndef K_CONCURRENTMAP_MAX_LOAD
+#   define K_CONCURRENTMAP_MAX_LOAD    75
+#endif
+
+typedef struct
+{
+    volatile i64    epoch;          // Epoch announced by a thread in a lookup, or 0.
+    u8              pad[K_CACHE_LINE_SIZE - sizeof(i64)];
+}
+ConcurrentMapReader;
+
+typedef struct
+{
+    void*   address;
+    i64     size;
+    i64     epoch;                  // Epoch when it was taken out of the map.
+}
+ConcurrentMapRetired;
+
+typedef struct ConcurrentMapTable ConcurrentMapTable;
+
+typedef struct
+{
+    ConcurrentMapTable* volatile    table;
+    volatile i64                    epoch;
+    ConcurrentMapReader*            readers;        // One per thread slot.
+    i64                             keySize;
+    i64                             valueSize;
+    i64                             valueOffset;    // Offset of the value from the start of an entry.
+    i64                             count;
+
+    // Only used by writers, with the lock held
+    Array(ConcurrentMapRetired)     retired;
+    i64                             used;           // Number of slots with an entry or a tombstone.
+#if OS_WIN32
+    SRWLOCK                         lock;
+#endif
+}
+ConcurrentMap;
+
+// Initialise an empty map.  Returns NO if memory could not be allocated, in which case the map can only be passed to
+// concurrentMapDone.
+bool concurrentMapInit(ConcurrentMap* map, i64 keySize, i64 valueSize);
+
+// Release all memory used by the map.  No threads can be using it.
+void concurrentMapDone(ConcurrentMap* map);
+
+// Copy the value associated with a key into value (which can be 0).  Returns NO if the key is not in the map.  Never
+// blocks, even while another thread is changing the map.
+bool concurrentMapFind(ConcurrentMap* map, const void* key, void* value);
+
+// Associate a value with a key, replacing any value it already had.  If the key is new, added is set to YES.  The
+// added pointer can be 0.  Returns NO if memory could not be allocated, leaving the map unchanged.
+bool concurrentMapSet(ConcurrentMap* map, const void* key, const void* value, bool* added);
+
+// Remove a key from the map.  Returns NO if the key was not in the map.
+bool concurrentMapRemove(ConcurrentMap* map, const void* key);
+
+// Number of keys in the map.  Only a hint while other threads are changing the map.
+i64 concurrentMapCount(const ConcurrentMap* map);
+
+// Give up the calling thread's reader slot so another thread can have it.
+void concurrentMapThreadDone();
+
+#define K_CONCURRENTMAP_INIT(map, k, v) concurrentMapInit((map), sizeof(k), sizeof(v))
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#ifdef K_IMPLEMENTATION
+
+#if COMPILER_MSVC
+#   include <intrin.h>
+#   define K_CONCURRENTMAP_BARRIER() _ReadWriteBarrier()
+#else
+#   error Define K_CONCURRENTMAP_BARRIER for your compiler.
+#endif
+
+#if OS_WIN32
+#   define K_CONCURRENTMAP_LOCK(map) AcquireSRWLockExclusive(&(map)->lock)
+#   define K_CONCURRENTMAP_UNLOCK(map) ReleaseSRWLockExclusive(&(map)->lock)
+#   define K_CONCURRENTMAP_LOCK_SHARED(map) AcquireSRWLockShared(&(map)->lock)
+#   define K_CONCURRENTMAP_UNLOCK_SHARED(map) ReleaseSRWLockShared(&(map)->lock)
+#else
+#   error Implement concurrent map locking for your OS.
+#endif
+
+#define K_CONCURRENTMAP_MIN_CAPACITY    16
+#define K_CONCURRENTMAP_TOMBSTONE       ((u8 *)1)
+
+typedef struct
+{
+    u8* volatile    entry;          // 0 for an empty slot, or K_CONCURRENTMAP_TOMBSTONE for a removed key.
+    volatile u64    hash;
+}
+ConcurrentMapSlot;
+
+struct ConcurrentMapTable
+{
+    i64                 capacity;   // Always a power of 2.
+    ConcurrentMapSlot   slots[1];
+};
+
+// Read a 64-bit value that other threads write.  A 32-bit CPU reads it in two halves that can come from different
+// writes, so read it with an interlocked compare exchange instead, which reads it in one go.
+internal i64 __concurrentMapRead(volatile i64* p)
+{
+#if CPU_X64
+    return *p;
+#else
+    return InterlockedCompareExchange64(p, 0, 0);
+#endif
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Reader slots
+//----------------------------------------------------------------------------------------------------------------------
+
+// Bit i is set while thread slot i is claimed
+volatile i64 gConcurrentMapThreadSlots[K_CONCURRENTMAP_MAX_THREADS / 64];
+
+// The calling thread's slot plus 1, or 0 if it does not have one
+K_THREAD_LOCAL i64 gConcurrentMapThread;
+
+// Return the index of the lowest clear bit in bits, which must not be all ones.
+internal i64 __concurrentMapFirstClear(i64 bits)
+{
+    unsigned long bit;
+
+#if CPU_X64
+    _BitScanForward64(&bit, ~(u64)bits);
+#else
+    // _BitScanForward64 only exists on 64-bit CPUs so scan the halves.
+    if (!_BitScanForward(&bit, ~(u32)bits))
+    {
+        _BitScanForward(&bit, ~(u32)((u64)bits >> 32));
+        bit += 32;
+    }
+#endif
+
+    return (i64)bit;
+}
+
+// Return the calling thread's slot, claiming one if it does not have one yet.  Returns -1 if every slot is taken.
+internal i64 __concurrentMapThread()
+{
+    for (i64 w = 0; !gConcurrentMapThread && w < K_CONCURRENTMAP_MAX_THREADS / 64; ++w)
+    {
+        i64 bits = gConcurrentMapThreadSlots[w];
+
+        while (~bits)
+        {
+            i64 bit = __concurrentMapFirstClear(bits);
+            i64 seen = _InterlockedCompareExchange64(&gConcurrentMapThreadSlots[w], bits | ((i64)1 << bit), bits);
+
+            if (seen == bits)
+            {
+                gConcurrentMapThread = w * 64 + bit + 1;
+                break;
+            }
+            bits = seen;
+        }
+    }
+
+    return gConcurrentMapThread - 1;
+}
+
+void concurrentMapThreadDone()
+{
+    i64 slot = gConcurrentMapThread - 1;
+
+    if (slot >= 0)
+    {
+        InterlockedAnd64(&gConcurrentMapThreadSlots[slot / 64], ~((i64)1 << (slot % 64)));
+        gConcurrentMapThread = 0;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Reclamation
+//----------------------------------------------------------------------------------------------------------------------
+
+// Make room to retire n more blocks without allocating, so that a change is never published only to find there is
+// no memory to remember what it took out.  Returns NO if the room could not be allocated.
+internal bool __concurrentMapReserveRetired(ConcurrentMap* map, i64 n)
+{
+    Array(ConcurrentMapRetired) retired = map->retired;
+
+    // Adding grows the array as soon as the count reaches the capacity, so leave one more
+    arrayReserve(retired, n + 1);
+    if (!retired) return NO;
+
+    map->retired = retired;
+    return YES;
+}
+
+// Hand memory that has been taken out of the map over to be freed once no reader can see it.  Room for it must have
+// been made with __concurrentMapReserveRetired.
+internal void __concurrentMapRetire(ConcurrentMap* map, void* address, i64 size)
+{
+    ConcurrentMapRetired r = { address, size, map->epoch };
+    arrayAdd(map->retired, r);
+}
+
+// Move the epoch on and wait until every reader that might still see memory taken out of the map has finished, so it
+// can be freed straight away.  Used when there is no room to retire it.
+internal void __concurrentMapSynchronise(ConcurrentMap* map)
+{
+    i64 epoch = InterlockedIncrement64(&map->epoch);
+
+    for (i64 i = 0; i < K_CONCURRENTMAP_MAX_THREADS; ++i)
+    {
+        for (;;)
+        {
+            i64 announced = __concurrentMapRead(&map->readers[i].epoch);
+            if (!announced || announced >= epoch) break;
+            YieldProcessor();
+        }
+    }
+}
+
+internal bool __concurrentMapFreeIfOld(const void* elem, void* context)
+{
+    const ConcurrentMapRetired* r = (const ConcurrentMapRetired *)elem;
+
+    if (r->epoch < *(i64 *)context)
+    {
+        K_FREE(r->address, r->size);
+        return YES;
+    }
+
+    return NO;
+}
+
+// Move the epoch on and free everything retired before the oldest epoch a reader is still in.
+internal void __concurrentMapReclaim(ConcurrentMap* map)
+{
+    // The interlocked increment is a full barrier, so anything retired before it is already out of the map when the
+    // reader slots are read
+    i64 oldest = InterlockedIncrement64(&map->epoch);
+
+    if (!arrayCount(map->retired)) return;
+
+    for (i64 i = 0; i < K_CONCURRENTMAP_MAX_THREADS; ++i)
+    {
+        i64 epoch = __concurrentMapRead(&map->readers[i].epoch);
+        if (epoch && epoch < oldest) oldest = epoch;
+    }
+
+    arrayRemoveIf(map->retired, &__concurrentMapFreeIfOld, &oldest);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Tables
+//----------------------------------------------------------------------------------------------------------------------
+
+internal i64 __concurrentMapTableSize(i64 capacity)
+{
+    return (i64)sizeof(ConcurrentMapTable) + (capacity - 1) * (i64)sizeof(ConcurrentMapSlot);
+}
+
+internal i64 __concurrentMapEntrySize(const ConcurrentMap* map)
+{
+    return map->valueOffset + map->valueSize;
+}
+
+// Find the slot a key is in, or the slot it should be added in (preferring the first tombstone on the way) if it is
+// not in the table.  Writers only.
+internal ConcurrentMapSlot* __concurrentMapProbe(ConcurrentMap* map, const void* key, u64 h, bool* found)
+{
+    ConcurrentMapTable* table = map->table;
+    i64 mask = table->capacity - 1;
+    ConcurrentMapSlot* gap = 0;
+
+    for (i64 i = (i64)h & mask;; i = (i + 1) & mask)
+    {
+        ConcurrentMapSlot* slot = &table->slots[i];
+
+        if (!slot->entry)
+        {
+            *found = NO;
+            return gap ? gap : slot;
+        }
+
+        if (slot->entry == K_CONCURRENTMAP_TOMBSTONE)
+        {
+            if (!gap) gap = slot;
+        }
+        else if (slot->hash == h && memcmp(slot->entry, key, (size_t)map->keySize) == 0)
+        {
+            *found = YES;
+            return slot;
+        }
+    }
+}
+
+// Publish a new table holding the current entries and retire the old one.  Returns NO if the new table could not be
+// allocated, leaving the old one in place.
+internal bool __concurrentMapRehash(ConcurrentMap* map, i64 capacity)
+{
+    ConcurrentMapTable* oldTable = map->table;
+    ConcurrentMapTable* table = (ConcurrentMapTable *)K_ALLOC(__concurrentMapTableSize(capacity));
+
+    if (!table) return NO;
+
+    memset(table->slots, 0, (size_t)capacity * sizeof(ConcurrentMapSlot));
+    table->capacity = capacity;
+
+    if (oldTable)
+    {
+        for (i64 i = 0; i < oldTable->capacity; ++i)
+        {
+            ConcurrentMapSlot* from = &oldTable->slots[i];
+
+            if (from->entry && from->entry != K_CONCURRENTMAP_TOMBSTONE)
+            {
+                i64 j = (i64)from->hash & (capacity - 1);
+                while (table->slots[j].entry) j = (j + 1) & (capacity - 1);
+                table->slots[j].hash = from->hash;
+                table->slots[j].entry = from->entry;
+            }
+        }
+    }
+
+    // The new table must be complete before readers can see it
+    K_CONCURRENTMAP_BARRIER();
+    map->table = table;
+    map->used = map->count;
+
+    if (oldTable) __concurrentMapRetire(map, oldTable, __concurrentMapTableSize(oldTable->capacity));
+    return YES;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Map control
+//----------------------------------------------------------------------------------------------------------------------
+
+bool concurrentMapInit(ConcurrentMap* map, i64 keySize, i64 valueSize)
+{
+    i64 readersSize = K_CONCURRENTMAP_MAX_THREADS * (i64)sizeof(ConcurrentMapReader);
+
+    map->table = 0;
+    map->epoch = 1;
+    map->readers = (ConcurrentMapReader *)K_ALLOC_ALIGNED(readersSize, K_CACHE_LINE_SIZE);
+    if (map->readers) memset(map->readers, 0, (size_t)readersSize);
+    map->keySize = keySize;
+    map->valueSize = valueSize;
+    map->valueOffset = (keySize + 7) & ~7;
+    map->count = 0;
+    map->retired = 0;
+    map->used = 0;
+#if OS_WIN32
+    InitializeSRWLock(&map->lock);
+#endif
+
+    return K_BOOL(map->readers);
+}
+
+void concurrentMapDone(ConcurrentMap* map)
+{
+    ConcurrentMapTable* table = map->table;
+
+    if (table)
+    {
+        for (i64 i = 0; i < table->capacity; ++i)
+        {
+            u8* entry = table->slots[i].entry;
+            if (entry && entry != K_CONCURRENTMAP_TOMBSTONE) K_FREE(entry, __concurrentMapEntrySize(map));
+        }
+        K_FREE(table, __concurrentMapTableSize(table->capacity));
+    }
+
+    for (i64 i = 0; i < arrayCount(map->retired); ++i)
+    {
+        K_FREE(map->retired[i].address, map->retired[i].size);
+    }
+    arrayRelease(map->retired);
+
+    K_FREE_ALIGNED(map->readers, K_CONCURRENTMAP_MAX_THREADS * (i64)sizeof(ConcurrentMapReader), K_CACHE_LINE_SIZE);
+
+    map->table = 0;
+    map->readers = 0;
+    map->retired = 0;
+    map->count = 0;
+    map->used = 0;
+}
+
+// Look a key up in a table that cannot be freed while we are reading it.
+internal bool __concurrentMapLookup(const ConcurrentMap* map, ConcurrentMapTable* table, const void* key, u64 h,
+    void* value)
+{
+    bool found = NO;
+
+    if (table)
+    {
+        i64 mask = table->capacity - 1;
+
+        for (i64 i = (i64)h & mask;; i = (i + 1) & mask)
+        {
+            // Read the entry before the hash.  Writers set the hash first, so a new entry always has the right one.
+            u8* entry = table->slots[i].entry;
+            K_CONCURRENTMAP_BARRIER();
+
+            if (!entry) break;
+            if (entry != K_CONCURRENTMAP_TOMBSTONE && table->slots[i].hash == h &&
+                memcmp(entry, key, (size_t)map->keySize) == 0)
+            {
+                if (value) memoryCopy(entry + map->valueOffset, value, map->valueSize);
+                found = YES;
+                break;
+            }
+        }
+    }
+
+    return found;
+}
+
+bool concurrentMapFind(ConcurrentMap* map, const void* key, void* value)
+{
+    i64 thread = __concurrentMapThread();
+    u64 h = hash((const u8 *)key, map->keySize);
+    bool found;
+
+    if (thread < 0)
+    {
+        // No reader slot is free, so keep writers out instead of announcing an epoch
+        K_CONCURRENTMAP_LOCK_SHARED(map);
+        found = __concurrentMapLookup(map, map->table, key, h, value);
+        K_CONCURRENTMAP_UNLOCK_SHARED(map);
+    }
+    else
+    {
+        volatile i64* announced = &map->readers[thread].epoch;
+
+        // The exchange is a full barrier, so the epoch is announced before any part of the table is read
+        InterlockedExchange64(announced, __concurrentMapRead(&map->epoch));
+        found = __concurrentMapLookup(map, map->table, key, h, value);
+        K_CONCURRENTMAP_BARRIER();
+        *announced = 0;
+    }
+
+    return found;
+}
+
+bool concurrentMapSet(ConcurrentMap* map, const void* key, const void* value, bool* added)
+{
+    u64 h = hash((const u8 *)key, map->keySize);
+    i64 entrySize = __concurrentMapEntrySize(map);
+    u8* entry = (u8 *)K_ALLOC(entrySize);
+    ConcurrentMapSlot* slot;
+    bool found;
+
+    if (!entry) return NO;
+
+    memoryCopy(key, entry, map->keySize);
+    memoryCopy(value, entry + map->valueOffset, map->valueSize);
+
+    K_CONCURRENTMAP_LOCK(map);
+
+    // A change retires at most the old table and the old entry
+    if (!__concurrentMapReserveRetired(map, 2))
+    {
+        K_CONCURRENTMAP_UNLOCK(map);
+        K_FREE(entry, entrySize);
+        return NO;
+    }
+
+    if (!map->table || (map->used + 1) * 100 > map->table->capacity * K_CONCURRENTMAP_MAX_LOAD)
+    {
+        // Grow, or just clear out the tombstones if there are enough of them
+        i64 capacity = K_CONCURRENTMAP_MIN_CAPACITY;
+        while ((map->count + 1) * 200 > capacity * K_CONCURRENTMAP_MAX_LOAD) capacity *= 2;
+        if (!__concurrentMapRehash(map, capacity))
+        {
+            K_CONCURRENTMAP_UNLOCK(map);
+            K_FREE(entry, entrySize);
+            return NO;
+        }
+    }
+
+    slot = __concurrentMapProbe(map, key, h, &found);
+    if (found)
+    {
+        // Readers either see the whole old entry or the whole new one
+        u8* oldEntry = slot->entry;
+        K_CONCURRENTMAP_BARRIER();
+        slot->entry = entry;
+        __concurrentMapRetire(map, oldEntry, entrySize);
+    }
+    else
+    {
+        if (!slot->entry) ++map->used;
+        slot->hash = h;
+        K_CONCURRENTMAP_BARRIER();
+        slot->entry = entry;
+        ++map->count;
+    }
+
+    __concurrentMapReclaim(map);
+    K_CONCURRENTMAP_UNLOCK(map);
+
+    if (added) *added = K_BOOL(!found);
+    return YES;
+}
+
+bool concurrentMapRemove(ConcurrentMap* map, const void* key)
+{
+    u64 h = hash((const u8 *)key, map->keySize);
+    bool found = NO;
+
+    K_CONCURRENTMAP_LOCK(map);
+
+    if (map->table)
+    {
+        ConcurrentMapSlot* slot = __concurrentMapProbe(map, key, h, &found);
+        if (found)
+        {
+            u8* entry = slot->entry;
+            bool retire = __concurrentMapReserveRetired(map, 1);
+
+            slot->entry = K_CONCURRENTMAP_TOMBSTONE;
+            --map->count;
+            if (retire)
+            {
+                __concurrentMapRetire(map, entry, __concurrentMapEntrySize(map));
+                __concurrentMapReclaim(map);
+            }
+            else
+            {
+                // Removing a key cannot fail, so wait for the readers rather than remember the entry
+                __concurrentMapSynchronise(map);
+                K_FREE(entry, __concurrentMapEntrySize(map));
+            }
+        }
+    }
+
+    K_CONCURRENTMAP_UNLOCK(map);
+
+    return found;
+}
+
+i64 concurrentMapCount(const ConcurrentMap* map)
+{
+    return map->count;
+}
+
+#undef K_CONCURRENTMAP_BARRIER
+#undef K_CONCURRENTMAP_LOCK
+#undef K_CONCURRENTMAP_UNLOCK
+#undef K_CONCURRENTMAP_LOCK_SHARED
+#undef K_CONCURRENTMAP_UNLOCK_SHARED
+#undef K_CONCURRENTMAP_MIN_CAPACITY
+#undef K_CONCURRENTMAP_TOMBSTONE
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#endif // K_IMPLEMENTATION
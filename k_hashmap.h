@@ -0,0 +1,392 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Hash map API
+// Open addressing hash map with keys and values stored inline.
+//
+// Each slot has a control byte: 0x80 for an empty slot, or the top 7 bits of the key's hash for a used one.  Probing
+// is linear but the control bytes are scanned 16 at a time with SSE2 so most lookups only touch a single group of
+// control bytes and a single key.  The first 15 control bytes are mirrored past the end of the table so a group can
+// always be loaded with one unaligned read, even when it wraps around.
+//
+// Deletion uses backward shifting rather than tombstones so the table never fills up with dead slots and lookups can
+// stop at the first empty slot they see.
+//
+// Keys are compared bytewise so any padding in a key type must be cleared.  Pointers returned by the map are only
+// valid until the next call to hashMapAdd, hashMapReserve or hashMapRemove.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+#include <kore/k_string.h>
+
+// The map grows when it would be fuller than this percentage.
+#ifndef K_HASHMAP_MAX_LOAD
+#   define K_HASHMAP_MAX_LOAD  80
+#endif
+
+#define K_HASHMAP_GROUP_SIZE    16
+#define K_HASHMAP_MIN_CAPACITY  K_HASHMAP_GROUP_SIZE
+
+typedef struct
+{
+    u8*     ctrl;           // Array of control bytes, with the mirrored group at the end.
+    u8*     slots;          // Array of keys and values.
+    i64     keySize;
+    i64     valueSize;
+    i64     valueOffset;    // Offset of the value from the start of a slot.
+    i64     slotSize;
+    i64     capacity;       // Always a power of 2, or 0 before the first add.
+    i64     count;
+}
+HashMap;
+
+// Initialise an empty hash map.  No memory is allocated until the first key is added.
+void hashMapInit(HashMap* map, i64 keySize, i64 valueSize);
+
+// Release all memory used by the hash map.
+void hashMapDone(HashMap* map);
+
+// Remove all keys but keep the memory.
+void hashMapClear(HashMap* map);
+
+// Make sure the map can hold count keys without rehashing.  Returns NO if memory could not be allocated, leaving the
+// map as it was.
+bool hashMapReserve(HashMap* map, i64 count);
+
+// Return the value associated with a key, or 0 if the key is not in the map.
+void* hashMapFind(const HashMap* map, const void* key);
+
+// Add a key and return a pointer to its value.  If the key is new, the value is uninitialised and added is set to YES.
+// The added pointer can be 0.  Returns 0 if memory could not be allocated.
+void* hashMapAdd(HashMap* map, const void* key, bool* added);
+
+// Remove a key from the map.  Returns NO if the key was not in the map.
+bool hashMapRemove(HashMap* map, const void* key);
+
+// Number of keys in the map.
+i64 hashMapCount(const HashMap* map);
+
+// Iterate over the used slots.  Start with index -1 and keep calling until it returns -1.  Do not add or remove keys
+// while iterating.
+i64 hashMapNext(const HashMap* map, i64 index);
+
+// Key and value at a slot index returned by hashMapNext.
+void* hashMapKey(const HashMap* map, i64 index);
+void* hashMapValue(const HashMap* map, i64 index);
+
+#define K_HASHMAP_INIT(map, k, v) hashMapInit((map), sizeof(k), sizeof(v))
+#define K_HASHMAP_FIND(map, key, t) ((t *)hashMapFind((map), (key)))
+#define K_HASHMAP_ADD(map, key, t, added) ((t *)hashMapAdd((map), (key), (added)))
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#ifdef K_IMPLEMENTATION
+
+#if COMPILER_MSVC
+#   include <intrin.h>
+#endif
+
+#if CPU_X86 || CPU_X64
+#   include <emmintrin.h>
+#endif
+
+#define K_HASHMAP_EMPTY 0x80
+#define K_HASHMAP_H2(h) ((u8)((h) >> 57))
+
+//----------------------------------------------------------------------------------------------------------------------
+// Group scanning
+//----------------------------------------------------------------------------------------------------------------------
+
+#if CPU_X86 || CPU_X64
+
+// Bit i is set if control byte i in the group matches h2.
+internal u32 __hashMapMatch(const u8* group, u8 h2)
+{
+    __m128i g = _mm_loadu_si128((const __m128i *)group);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)h2)));
+}
+
+// Bit i is set if slot i in the group is empty.
+internal u32 __hashMapMatchEmpty(const u8* group)
+{
+    return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+}
+
+#else
+#   error Implement hash map group scanning for your CPU.
+#endif
+
+internal i64 __hashMapFirstBit(u32 mask)
+{
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (i64)index;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Slots
+//----------------------------------------------------------------------------------------------------------------------
+
+internal u8* __hashMapSlot(const HashMap* map, i64 index)
+{
+    return map->slots + index * map->slotSize;
+}
+
+internal u64 __hashMapHash(const HashMap* map, const void* key)
+{
+    return hash((const u8 *)key, map->keySize);
+}
+
+internal void __hashMapSetCtrl(HashMap* map, i64 index, u8 c)
+{
+    map->ctrl[index] = c;
+    if (index < K_HASHMAP_GROUP_SIZE - 1)
+    {
+        map->ctrl[map->capacity + index] = c;
+    }
+}
+
+// Find the first empty slot on the probe sequence for a hash.  There must be one.
+internal i64 __hashMapFindEmpty(const HashMap* map, u64 h)
+{
+    i64 mask = map->capacity - 1;
+    i64 pos = (i64)h & mask;
+
+    for (;;)
+    {
+        u32 empty = __hashMapMatchEmpty(map->ctrl + pos);
+        if (empty) return (pos + __hashMapFirstBit(empty)) & mask;
+        pos = (pos + K_HASHMAP_GROUP_SIZE) & mask;
+    }
+}
+
+// Return the slot index holding the key, or -1.
+internal i64 __hashMapFindIndex(const HashMap* map, const void* key, u64 h)
+{
+    i64 mask = map->capacity - 1;
+    i64 pos = (i64)h & mask;
+    u8 h2 = K_HASHMAP_H2(h);
+
+    if (!map->count) return -1;
+
+    for (;;)
+    {
+        const u8* group = map->ctrl + pos;
+        u32 empty = __hashMapMatchEmpty(group);
+        u32 match = __hashMapMatch(group, h2);
+
+        // With linear probing, the key can not be beyond the first empty slot.
+        if (empty) match &= (empty & (0 - empty)) - 1;
+
+        while (match)
+        {
+            i64 index = (pos + __hashMapFirstBit(match)) & mask;
+            if (memoryCompare(__hashMapSlot(map, index), key, map->keySize) == 0) return index;
+            match &= match - 1;
+        }
+
+        if (empty) return -1;
+        pos = (pos + K_HASHMAP_GROUP_SIZE) & mask;
+    }
+}
+
+// Allocate empty tables for a capacity.  Returns NO if they could not be allocated, leaving the map's tables alone.
+internal bool __hashMapAllocTables(HashMap* map, i64 capacity)
+{
+    Array(u8) ctrl = 0;
+    Array(u8) slots = 0;
+
+    // Arrays grow when they become full, so reserve one more than is used to allocate each table only once
+    arrayReserveAligned(ctrl, capacity + K_HASHMAP_GROUP_SIZE + 1, K_HASHMAP_GROUP_SIZE);
+    arrayReserve(slots, capacity * map->slotSize + 1);
+    if (!ctrl || !slots)
+    {
+        arrayRelease(ctrl);
+        arrayRelease(slots);
+        return NO;
+    }
+
+    arrayExpand(ctrl, capacity + K_HASHMAP_GROUP_SIZE);
+    arrayExpand(slots, capacity * map->slotSize);
+    memset(ctrl, K_HASHMAP_EMPTY, (size_t)(capacity + K_HASHMAP_GROUP_SIZE));
+
+    map->ctrl = ctrl;
+    map->slots = slots;
+    map->capacity = capacity;
+    return YES;
+}
+
+// Move the keys into tables of a new capacity.  Returns NO if the tables could not be allocated, leaving the map as
+// it was.
+internal bool __hashMapRehash(HashMap* map, i64 capacity)
+{
+    u8* oldCtrl = map->ctrl;
+    u8* oldSlots = map->slots;
+    i64 oldCapacity = map->capacity;
+
+    if (!__hashMapAllocTables(map, capacity)) return NO;
+
+    for (i64 i = 0; i < oldCapacity; ++i)
+    {
+        if (!(oldCtrl[i] & K_HASHMAP_EMPTY))
+        {
+            const u8* slot = oldSlots + i * map->slotSize;
+            u64 h = __hashMapHash(map, slot);
+            i64 index = __hashMapFindEmpty(map, h);
+
+            __hashMapSetCtrl(map, index, K_HASHMAP_H2(h));
+            memoryCopy(slot, __hashMapSlot(map, index), map->slotSize);
+        }
+    }
+
+    arrayRelease(oldCtrl);
+    arrayRelease(oldSlots);
+    return YES;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Public API
+//----------------------------------------------------------------------------------------------------------------------
+
+void hashMapInit(HashMap* map, i64 keySize, i64 valueSize)
+{
+    K_ASSERT(keySize > 0, "Hash map keys must have a size");
+    K_ASSERT(valueSize >= 0, "Hash map values can not have a negative size");
+
+    map->ctrl = 0;
+    map->slots = 0;
+    map->keySize = keySize;
+    map->valueSize = valueSize;
+    map->valueOffset = (keySize + 7) & ~7;
+    map->slotSize = (map->valueOffset + valueSize + 7) & ~7;
+    map->capacity = 0;
+    map->count = 0;
+}
+
+void hashMapDone(HashMap* map)
+{
+    arrayRelease(map->ctrl);
+    arrayRelease(map->slots);
+    map->ctrl = 0;
+    map->slots = 0;
+    map->capacity = 0;
+    map->count = 0;
+}
+
+void hashMapClear(HashMap* map)
+{
+    if (map->ctrl)
+    {
+        memset(map->ctrl, K_HASHMAP_EMPTY, (size_t)(map->capacity + K_HASHMAP_GROUP_SIZE));
+    }
+    map->count = 0;
+}
+
+bool hashMapReserve(HashMap* map, i64 count)
+{
+    i64 capacity = map->capacity ? map->capacity : K_HASHMAP_MIN_CAPACITY;
+
+    while (count * 100 > capacity * K_HASHMAP_MAX_LOAD) capacity *= 2;
+    return capacity <= map->capacity || __hashMapRehash(map, capacity);
+}
+
+void* hashMapFind(const HashMap* map, const void* key)
+{
+    i64 index = __hashMapFindIndex(map, key, __hashMapHash(map, key));
+    return index < 0 ? 0 : __hashMapSlot(map, index) + map->valueOffset;
+}
+
+void* hashMapAdd(HashMap* map, const void* key, bool* added)
+{
+    u64 h = __hashMapHash(map, key);
+    i64 index = map->capacity ? __hashMapFindIndex(map, key, h) : -1;
+    u8* slot;
+
+    if (index >= 0)
+    {
+        if (added) *added = NO;
+        return __hashMapSlot(map, index) + map->valueOffset;
+    }
+
+    if (!hashMapReserve(map, map->count + 1))
+    {
+        if (added) *added = NO;
+        return 0;
+    }
+    index = __hashMapFindEmpty(map, h);
+    slot = __hashMapSlot(map, index);
+
+    __hashMapSetCtrl(map, index, K_HASHMAP_H2(h));
+    memoryCopy(key, slot, map->keySize);
+    ++map->count;
+
+    if (added) *added = YES;
+    return slot + map->valueOffset;
+}
+
+bool hashMapRemove(HashMap* map, const void* key)
+{
+    i64 mask = map->capacity - 1;
+    i64 hole = map->capacity ? __hashMapFindIndex(map, key, __hashMapHash(map, key)) : -1;
+    i64 index = hole;
+
+    if (hole < 0) return NO;
+
+    // Shift later keys in the cluster back into the hole as long as that does not move them before their home slot.
+    for (;;)
+    {
+        i64 home;
+        index = (index + 1) & mask;
+        if (map->ctrl[index] & K_HASHMAP_EMPTY) break;
+
+        home = (i64)__hashMapHash(map, __hashMapSlot(map, index)) & mask;
+        if (((index - home) & mask) >= ((index - hole) & mask))
+        {
+            __hashMapSetCtrl(map, hole, map->ctrl[index]);
+            memoryCopy(__hashMapSlot(map, index), __hashMapSlot(map, hole), map->slotSize);
+            hole = index;
+        }
+    }
+
+    __hashMapSetCtrl(map, hole, K_HASHMAP_EMPTY);
+    --map->count;
+
+    return YES;
+}
+
+i64 hashMapCount(const HashMap* map)
+{
+    return map->count;
+}
+
+i64 hashMapNext(const HashMap* map, i64 index)
+{
+    for (++index; index < map->capacity; ++index)
+    {
+        if (!(map->ctrl[index] & K_HASHMAP_EMPTY)) return index;
+    }
+
+    return -1;
+}
+
+void* hashMapKey(const HashMap* map, i64 index)
+{
+    return __hashMapSlot(map, index);
+}
+
+void* hashMapValue(const HashMap* map, i64 index)
+{
+    return __hashMapSlot(map, index) + map->valueOffset;
+}
+
+#undef K_HASHMAP_EMPTY
+#undef K_HASHMAP_H2
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#endif // K_IMPLEMENTATION
@@ -0,0 +1,320 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Heap API
+// Min-heap priority queue of (key, id) entries stored in an Array.  The entry with the smallest key is at the top.
+//
+// The heap can be binary or 4-ary.  A 4-ary heap is half the depth of a binary one and all 4 children of a node are
+// compared in one go.  The array starts with arity - 1 unused entries and is cache line aligned, so the children of
+// every node share a single cache line.
+//
+// An indexed heap also keeps an Array mapping each id to its position in the heap, which allows heapDecreaseKey and
+// heapRemove by id.  Ids in an indexed heap must be unique, small, non-negative integers since they index that Array.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+
+typedef struct
+{
+    i64     key;
+    i64     id;
+}
+HeapEntry;
+
+typedef struct
+{
+    Array(HeapEntry)    entries;
+    Array(i64)          positions;      // Position of each id in the heap, or -1.  Indexed heaps only.
+    i64                 arity;
+    bool                indexed;
+}
+Heap;
+
+// Initialise an empty heap.  Arity must be 2 or 4.
+void heapInit(Heap* heap, i64 arity, bool indexed);
+
+// Release the heap's memory.
+void heapDone(Heap* heap);
+
+// Remove all entries.
+void heapClear(Heap* heap);
+
+// Number of entries in the heap.
+i64 heapCount(const Heap* heap);
+
+// Add an entry.  Returns NO if memory could not be allocated, leaving the heap unchanged.
+bool heapPush(Heap* heap, i64 key, i64 id);
+
+// Remove the entry with the smallest key and copy it to entry (which can be 0).  Returns NO if the heap is empty.
+bool heapPop(Heap* heap, HeapEntry* entry);
+
+// Return the entry with the smallest key without removing it, or 0 if the heap is empty.
+HeapEntry* heapPeek(Heap* heap);
+
+// Replace the contents of the heap with count entries.  This is O(n), faster than pushing them one at a time.  Returns
+// NO if memory could not be allocated, leaving the heap empty.
+bool heapify(Heap* heap, const HeapEntry* entries, i64 count);
+
+// Lower the key of an entry by id.  Returns NO if the id is not in the heap.  Indexed heaps only.
+bool heapDecreaseKey(Heap* heap, i64 id, i64 key);
+
+// Remove an entry by id.  Returns NO if the id is not in the heap.  Indexed heaps only.
+bool heapRemove(Heap* heap, i64 id);
+
+// Return YES if the id is in the heap.  Indexed heaps only.
+bool heapContains(const Heap* heap, i64 id);
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#ifdef K_IMPLEMENTATION
+
+// Entry i of the heap.  The first arity - 1 array entries are padding.
+#define K_HEAP_AT(heap, i) ((heap)->entries[(i) + (heap)->arity - 1])
+
+internal void __heapPlace(Heap* heap, i64 i, HeapEntry e)
+{
+    K_HEAP_AT(heap, i) = e;
+    if (heap->indexed) heap->positions[e.id] = i;
+}
+
+internal void __heapSiftUp(Heap* heap, i64 i, HeapEntry e)
+{
+    while (i > 0)
+    {
+        i64 parent = (i - 1) / heap->arity;
+        if (K_HEAP_AT(heap, parent).key <= e.key) break;
+        __heapPlace(heap, i, K_HEAP_AT(heap, parent));
+        i = parent;
+    }
+    __heapPlace(heap, i, e);
+}
+
+internal void __heapSiftDown(Heap* heap, i64 i, HeapEntry e)
+{
+    i64 count = heapCount(heap);
+
+    for (;;)
+    {
+        i64 first = i * heap->arity + 1;
+        i64 last = K_MIN(first + heap->arity, count);
+        i64 best = first;
+
+        if (first >= count) break;
+        for (i64 c = first + 1; c < last; ++c)
+        {
+            if (K_HEAP_AT(heap, c).key < K_HEAP_AT(heap, best).key) best = c;
+        }
+
+        if (K_HEAP_AT(heap, best).key >= e.key) break;
+        __heapPlace(heap, i, K_HEAP_AT(heap, best));
+        i = best;
+    }
+    __heapPlace(heap, i, e);
+}
+
+// Make sure the position map can be indexed by id.  Returns NO if it could not be allocated, leaving it as it was.
+internal bool __heapTrackId(Heap* heap, i64 id)
+{
+    K_ASSERT(id >= 0, "Ids in an indexed heap must be non-negative");
+    if (id >= arrayCount(heap->positions))
+    {
+        Array(i64) positions = heap->positions;
+        i64 n = id + 1 - arrayCount(positions);
+        i64* p;
+
+        // Expanding grows the array as soon as the count reaches the capacity, so reserve one more to grow it once
+        arrayReserve(positions, n + 1);
+        if (!positions) return NO;
+
+        heap->positions = positions;
+        p = arrayExpand(heap->positions, n);
+        for (i64 i = 0; i < n; ++i) p[i] = -1;
+    }
+
+    return YES;
+}
+
+// Make room for count more entries, setting up the padding the first time.  Expanding by up to count entries will
+// not grow the array again.  Returns NO if memory could not be allocated, leaving the entries as they were.
+internal bool __heapReserve(Heap* heap, i64 count)
+{
+    Array(HeapEntry) entries = heap->entries;
+
+    if (!entries)
+    {
+        arrayReserveAligned(entries, heap->arity - 1 + count + 1, K_CACHE_LINE_SIZE);
+        if (!entries) return NO;
+        arrayExpand(entries, heap->arity - 1);
+    }
+    else
+    {
+        arrayReserve(entries, count + 1);
+        if (!entries) return NO;
+    }
+
+    heap->entries = entries;
+    return YES;
+}
+
+void heapInit(Heap* heap, i64 arity, bool indexed)
+{
+    K_ASSERT(arity == 2 || arity == 4, "Only binary and 4-ary heaps are supported");
+
+    heap->entries = 0;
+    heap->positions = 0;
+    heap->arity = arity;
+    heap->indexed = indexed;
+}
+
+void heapDone(Heap* heap)
+{
+    arrayRelease(heap->entries);
+    arrayRelease(heap->positions);
+    heap->entries = 0;
+    heap->positions = 0;
+}
+
+void heapClear(Heap* heap)
+{
+    if (heap->entries) __arrayCount(heap->entries) = heap->arity - 1;
+    for (i64 i = 0; i < arrayCount(heap->positions); ++i) heap->positions[i] = -1;
+}
+
+i64 heapCount(const Heap* heap)
+{
+    return heap->entries ? arrayCount(heap->entries) - (heap->arity - 1) : 0;
+}
+
+bool heapPush(Heap* heap, i64 key, i64 id)
+{
+    HeapEntry e = { key, id };
+
+    if (heap->indexed)
+    {
+        if (!__heapTrackId(heap, id)) return NO;
+        K_ASSERT(heap->positions[id] < 0, "Id is already in the heap");
+    }
+
+    if (!__heapReserve(heap, 1)) return NO;
+    arrayExpand(heap->entries, 1);
+    __heapSiftUp(heap, heapCount(heap) - 1, e);
+
+    return YES;
+}
+
+bool heapPop(Heap* heap, HeapEntry* entry)
+{
+    i64 count = heapCount(heap);
+    HeapEntry top;
+
+    if (!count) return NO;
+
+    top = K_HEAP_AT(heap, 0);
+    if (heap->indexed) heap->positions[top.id] = -1;
+
+    --__arrayCount(heap->entries);
+    if (count > 1) __heapSiftDown(heap, 0, K_HEAP_AT(heap, count - 1));
+
+    if (entry) *entry = top;
+    return YES;
+}
+
+HeapEntry* heapPeek(Heap* heap)
+{
+    return heapCount(heap) ? &K_HEAP_AT(heap, 0) : 0;
+}
+
+bool heapify(Heap* heap, const HeapEntry* entries, i64 count)
+{
+    heapClear(heap);
+    if (!count) return YES;
+
+    if (heap->indexed)
+    {
+        // Make room for the largest id first so the position map grows once and nothing has to be undone
+        i64 maxId = 0;
+        for (i64 i = 0; i < count; ++i) maxId = K_MAX(maxId, entries[i].id);
+        if (!__heapTrackId(heap, maxId)) return NO;
+    }
+
+    if (!__heapReserve(heap, count)) return NO;
+    memoryCopy(entries, arrayExpand(heap->entries, count), count * sizeof(HeapEntry));
+
+    if (heap->indexed)
+    {
+        for (i64 i = 0; i < count; ++i)
+        {
+            K_ASSERT(entries[i].id >= 0, "Ids in an indexed heap must be non-negative");
+            K_ASSERT(heap->positions[entries[i].id] < 0, "Ids must be unique");
+            heap->positions[entries[i].id] = i;
+        }
+    }
+
+    // Sift down every parent, starting with the last one
+    for (i64 i = (count - 2) / heap->arity; i >= 0; --i)
+    {
+        __heapSiftDown(heap, i, K_HEAP_AT(heap, i));
+    }
+
+    return YES;
+}
+
+bool heapDecreaseKey(Heap* heap, i64 id, i64 key)
+{
+    i64 i = heapContains(heap, id) ? heap->positions[id] : -1;
+    HeapEntry e;
+
+    if (i < 0) return NO;
+
+    e = K_HEAP_AT(heap, i);
+    K_ASSERT(key <= e.key, "Key can only be decreased");
+    e.key = key;
+    __heapSiftUp(heap, i, e);
+
+    return YES;
+}
+
+bool heapRemove(Heap* heap, i64 id)
+{
+    i64 i = heapContains(heap, id) ? heap->positions[id] : -1;
+    i64 last = heapCount(heap) - 1;
+    HeapEntry e;
+
+    if (i < 0) return NO;
+
+    heap->positions[id] = -1;
+    e = K_HEAP_AT(heap, last);
+    --__arrayCount(heap->entries);
+
+    // Put the last entry in the gap and move it whichever way it needs to go
+    if (i != last)
+    {
+        if (i > 0 && e.key < K_HEAP_AT(heap, (i - 1) / heap->arity).key)
+        {
+            __heapSiftUp(heap, i, e);
+        }
+        else
+        {
+            __heapSiftDown(heap, i, e);
+        }
+    }
+
+    return YES;
+}
+
+bool heapContains(const Heap* heap, i64 id)
+{
+    K_ASSERT(heap->indexed, "Only indexed heaps can look up ids");
+    return K_BOOL(id >= 0 && id < arrayCount(heap->positions) && heap->positions[id] >= 0);
+}
+
+#undef K_HEAP_AT
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#endif // K_IMPLEMENTATION
@@ -6,12 +6,95 @@
 
 #include <kore/k_platform.h>
 
+// Set K_MEMORY_SLAB to YES to route K_ALLOC/K_REALLOC/K_FREE through a size-class slab allocator instead of libc.
+#ifndef K_MEMORY_SLAB
+#   define K_MEMORY_SLAB       NO
+#endif
+
+// Default size at which memoryCopy and memoryClear switch to non-temporal stores.
+#ifndef K_MEMORY_STREAMING_THRESHOLD
+#   define K_MEMORY_STREAMING_THRESHOLD MB(4)
+#endif
+
+// Set K_MEMORY_TRACKING to YES to keep per-call-site allocation statistics and report leaks at exit.
+#ifndef K_MEMORY_TRACKING
+#   define K_MEMORY_TRACKING   NO
+#endif
+
+// Maximum number of distinct call sites that can be tracked.  Must be a power of two.
+#ifndef K_MEMORY_TRACKING_SITES
+#   define K_MEMORY_TRACKING_SITES 1024
+#endif
+
+// Number of bytes of each size class a thread caches before handing slots back to the global slab lists.
+#ifndef K_SLAB_CACHE_BYTES
+#   define K_SLAB_CACHE_BYTES  KB(16)
+#endif
+
 #ifndef K_ARENA_INCREMENT
 #   define K_ARENA_INCREMENT   4096
 #endif
 
 #ifndef K_ARENA_ALIGN
-#   define K_ARENA_ALIGN       8
+#   define K_ARENA_ALIGN       16
+#endif
+
+// Set K_ARENA_STATS to YES to record usage statistics in every Arena and keep a registry of all live arenas.
+#ifndef K_ARENA_STATS
+#   define K_ARENA_STATS       NO
+#endif
+
+// Alignment guaranteed by memoryAlloc.
+#define K_MEMORY_ALIGN          (sizeof(void*) * 2)
+
+#define K_CACHE_LINE_SIZE       64
+#define K_PAGE_SIZE             4096
+
+// Granularity that virtual arenas commit and decommit pages with.  Must be a multiple of the OS page size.
+#ifndef K_ARENA_COMMIT_SIZE
+#   define K_ARENA_COMMIT_SIZE KB(64)
+#endif
+
+#ifndef K_BLOCK_ARENA_SIZE
+#   define K_BLOCK_ARENA_SIZE  KB(64)
+#endif
+
+// Default number of bytes a concurrent arena cache claims at a time.
+#ifndef K_CONCURRENT_ARENA_CHUNK_SIZE
+#   define K_CONCURRENT_ARENA_CHUNK_SIZE   KB(32)
+#endif
+
+// Granularity that concurrent arenas commit pages with.  Larger steps mean threads wait on the commit lock less often.
+#ifndef K_CONCURRENT_ARENA_COMMIT_SIZE
+#   define K_CONCURRENT_ARENA_COMMIT_SIZE  MB(1)
+#endif
+
+// Heap arrays that grow beyond this many bytes move to reserved virtual memory and from then on grow in place.  If
+// the address range can not be reserved they stay on the heap.
+#ifndef K_ARRAY_VIRTUAL_THRESHOLD
+#   define K_ARRAY_VIRTUAL_THRESHOLD   MB(64)
+#endif
+
+// Minimum address range reserved for a virtual array.  A 32-bit process has little address space to spare.
+#ifndef K_ARRAY_VIRTUAL_RESERVE
+#   if CPU_X64
+#       define K_ARRAY_VIRTUAL_RESERVE ((i64)GB(1) * 32)
+#   else
+#       define K_ARRAY_VIRTUAL_RESERVE MB(256)
+#   endif
+#endif
+
+#ifndef K_SCRATCH_COUNT
+#   define K_SCRATCH_COUNT     2
+#endif
+
+// Address range reserved for each scratch arena of each thread.  A 32-bit process has little address space to spare.
+#ifndef K_SCRATCH_RESERVE
+#   if CPU_X64
+#       define K_SCRATCH_RESERVE   GB(1)
+#   else
+#       define K_SCRATCH_RESERVE   MB(64)
+#   endif
 #endif
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -27,45 +110,296 @@ void memoryMove(const void* src, void* dst, i64 numBytes);
 int memoryCompare(const void* mem1, const void* mem2, i64 numBytes);
 void memoryClear(void* mem, i64 numBytes);
 
+// Copies and clears of at least this many bytes use non-temporal stores, which bypass the cache.
+void memorySetStreamingThreshold(i64 numBytes);
+
 #define K_ALLOC(numBytes) memoryAlloc((numBytes), __FILE__, __LINE__)
 #define K_REALLOC(address, oldNumBytes, newNumBytes) memoryRealloc((address), (oldNumBytes), (newNumBytes), __FILE__, __LINE__)
 #define K_FREE(address, oldNumBytes) memoryFree((address), (oldNumBytes), __FILE__, __LINE__)
 
+// Allocation aligned to a power of two number of bytes, for example 32 or 64 for AVX loads, K_CACHE_LINE_SIZE to
+// avoid false sharing or K_PAGE_SIZE for I/O.  Blocks must be reallocated and freed with the same alignment.
+void* memoryAllocAligned(i64 numBytes, i64 alignment, const char* file, int line);
+void* memoryReallocAligned(void* address, i64 oldNumBytes, i64 newNumBytes, i64 alignment, const char* file, int line);
+void memoryFreeAligned(void* address, i64 numBytes, i64 alignment, const char* file, int line);
+
+#define K_ALLOC_ALIGNED(numBytes, alignment) memoryAllocAligned((numBytes), (alignment), __FILE__, __LINE__)
+#define K_REALLOC_ALIGNED(address, oldNumBytes, newNumBytes, alignment) memoryReallocAligned((address), (oldNumBytes), (newNumBytes), (alignment), __FILE__, __LINE__)
+#define K_FREE_ALIGNED(address, oldNumBytes, alignment) memoryFreeAligned((address), (oldNumBytes), (alignment), __FILE__, __LINE__)
+
+// Return the calling thread's cached memory to the global slab lists.  Call this before a thread that allocated
+// memory exits.  Does nothing unless K_MEMORY_SLAB is enabled.
+void memoryThreadDone();
+
+// Print every call site that still has live allocations.  This is called automatically at exit when
+// K_MEMORY_TRACKING is enabled.
+void memoryReportLeaks();
+
+// Write the statistics of every call site as JSON.  Does nothing unless K_MEMORY_TRACKING is enabled.
+void memoryDumpJson(FILE* f);
+
+//----------------------------------------------------------------------------------------------------------------------
+// NUMA
+// On machines with more than one NUMA node, memory attached to another node is slower to reach.  By default a page
+// is placed on the node of the thread that first touches it, which is wrong when one thread sets memory up for
+// another to use.  Virtual arenas, pools and virtual arrays can instead be bound to a node, so their pages are
+// placed there whichever thread commits or touches them.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_NUMA_NONE         -1      // No preference: pages go to the node of the thread that first touches them.
+#define K_NUMA_CURRENT      -2      // The node of the calling thread when the memory is set up.
+
+// Return the NUMA node of the processor the calling thread is running on.
+i64 memoryNumaNode();
+
+// Return the number of NUMA nodes, which is 1 on machines that are not NUMA.
+i64 memoryNumaNodeCount();
+
 //----------------------------------------------------------------------------------------------------------------------
 // Arena allocator
 //----------------------------------------------------------------------------------------------------------------------
 
-typedef struct
+typedef struct Arena
 {
     u8*     start;
     u8*     end;
     i64     cursor;
     i64     restore;
+    i64     reserved;       // Size of the address range of virtual and huge arenas, 0 for heap arenas.
+    i64     kind;           // K_ARENA_HEAP etc.
+    i64     numaNode;       // Node a virtual arena commits its pages on, or K_NUMA_NONE.
+#if K_ARENA_STATS
+    const char*     name;           // Set by arenaSetName, or 0.
+    i64             highWater;      // Highest the cursor has been.
+    i64             alignPadding;   // Bytes skipped by arenaAlign and aligned allocations.
+    i64             numGrows;       // Number of times a heap arena was reallocated or a virtual arena committed pages.
+    i64             pushDepth;      // Number of restore points.
+    i64             maxPushDepth;
+    struct Arena*   prevArena;      // Links in the registry of live arenas.
+    struct Arena*   nextArena;
+#endif
 }
 Arena;
 
+// Kinds of arena memory
+#define K_ARENA_HEAP        0       // Single buffer that grows with realloc.
+#define K_ARENA_VIRTUAL     1       // Reserved address range with pages committed on demand.
+#define K_ARENA_HUGE        2       // Fixed-size buffer backed by large pages.
+#define K_ARENA_MAPPED      3       // Fixed-size view of a file saved with arenaSave (see k_blob.h).
+
 // Create a new Arena.
 void arenaInit(Arena* arena, i64 initialSize);
 
+// Create a new Arena that reserves an address range up front and commits pages on demand as the cursor advances.
+// The memory never moves so pointers into the arena remain valid until arenaDone.  Pages are decommitted by
+// arenaPop.
+void arenaInitVirtual(Arena* arena, i64 reserveSize);
+
+// Create a new fixed-size Arena backed by large (2MB) pages to cut TLB misses on big, randomly accessed arenas.
+// Large pages cannot be committed on demand, so the whole size is committed up front and the arena cannot grow.  If
+// the process is not allowed large pages (it needs the "Lock pages in memory" privilege), this falls back to
+// arenaInitVirtual.
+void arenaInitHuge(Arena* arena, i64 size);
+
+// Create a new virtual Arena whose pages are committed on a NUMA node.  The node can be K_NUMA_CURRENT for the
+// calling thread's node.  Use this when the arena is set up by one thread and used by threads on another node.
+void arenaInitNuma(Arena* arena, i64 reserveSize, i64 node);
+
 // Deallocate the memory used by the arena.
 void arenaDone(Arena* arena);
 
-// Allocate some memory on the arena.
+// Allocate some memory on the arena.  Returns 0 if the arena is out of memory.  Arenas loaded from a file
+// (K_ARENA_MAPPED) are full and must not be allocated from.
 void* arenaAlloc(Arena* arena, i64 numytes);
 
-// Ensure that the next allocation is aligned to 16 bytes boundary.
+// Ensure that the next allocation is aligned to a K_ARENA_ALIGN bytes boundary.
 void* arenaAlign(Arena* arena);
 
 // Combine alignment and allocation into one function for convenience.
 void* arenaAlignedAlloc(Arena* arena, i64 numBytes);
 
-// Create a restore point so that any future allocations can be deallocated in one go.
-void arenaPush(Arena* arena);
+// Ensure that the next allocation is aligned to a power of two number of bytes.  The address is aligned, not the
+// offset into the arena.  Heap arenas move when they grow so alignments greater than K_MEMORY_ALIGN only hold until
+// the next growth; use a virtual arena if that matters.
+void* arenaAlignTo(Arena* arena, i64 alignment);
+
+// Combine arbitrary alignment and allocation into one function for convenience.
+void* arenaAlignedAllocTo(Arena* arena, i64 numBytes, i64 alignment);
 
-// Deallocate memory from the previous restore point.
+// Create a restore point so that any future allocations can be deallocated in one go.  Loaded arenas must not be
+// pushed.  Returns NO if the arena is out of memory, in which case no restore point is made and there must be no
+// matching arenaPop.
+bool arenaPush(Arena* arena);
+
+// Deallocate memory from the previous restore point.  Loaded arenas must not be popped.
 void arenaPop(Arena* arena);
 
 #define K_ARENA_ALLOC(arena, t, count) (t *)arenaAlignedAlloc((arena), sizeof(t) * (count))
+#define K_ARENA_ALLOC_ALIGNED(arena, t, count, alignment) (t *)arenaAlignedAllocTo((arena), sizeof(t) * (count), (alignment))
+
+// Arena statistics
+// With K_ARENA_STATS enabled, every arena registers itself when it is initialised and unregisters in arenaDone, so an
+// Arena must not be copied or moved while it is live.  The statistics are not synchronised; dump them while the
+// arenas are not being used if exact figures matter.  Compare the high-water mark with the initial size to pick
+// better sizes for arenaInit.  These functions do nothing unless K_ARENA_STATS is enabled.
+
+// Give an arena a name to identify it in the statistics.  The string is not copied.
+void arenaSetName(Arena* arena, const char* name);
+
+// Print the statistics of every live arena.
+void arenaDumpStats(FILE* f);
+
+// Write the statistics of every live arena as JSON.
+void arenaDumpStatsJson(FILE* f);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Block arena allocator
+// A block arena links fixed-size blocks together instead of growing a single buffer, so memory never moves.  Blocks
+// released by blockArenaPop or blockArenaReset are kept on a free list and reused, so memory use is bounded by the
+// peak.  Allocations larger than a block get a block of their own, which is returned to the heap when released.
+//----------------------------------------------------------------------------------------------------------------------
+
+typedef struct ArenaBlock
+{
+    struct ArenaBlock*  prev;       // Previous block in the chain, or next block on the free list.
+    i64                 size;       // Number of usable bytes following this header.
+}
+ArenaBlock;
+
+typedef struct
+{
+    ArenaBlock*     block;          // Current block being allocated from.
+    i64             cursor;         // Offset into the current block.
+    i64             blockSize;
+    ArenaBlock*     freeBlocks;
+    void*           restore;
+}
+BlockArena;
+
+// Create a new block arena.  If blockSize is 0, K_BLOCK_ARENA_SIZE is used.
+void blockArenaInit(BlockArena* arena, i64 blockSize);
+
+// Deallocate all the blocks used by the arena, including those on the free list.
+void blockArenaDone(BlockArena* arena);
+
+// Allocate some memory on the arena.
+void* blockArenaAlloc(BlockArena* arena, i64 numBytes);
+
+// Ensure that the next allocation is aligned to K_ARENA_ALIGN.
+void* blockArenaAlign(BlockArena* arena);
+
+// Combine alignment and allocation into one function for convenience.
+void* blockArenaAlignedAlloc(BlockArena* arena, i64 numBytes);
+
+// Create a restore point so that any future allocations can be deallocated in one go.  Returns NO if a block could
+// not be allocated, in which case no restore point is made and there must be no matching blockArenaPop.
+bool blockArenaPush(BlockArena* arena);
+
+// Deallocate memory from the previous restore point, recycling any blocks allocated since.
+void blockArenaPop(BlockArena* arena);
+
+// Deallocate everything in the arena, recycling all its blocks.
+void blockArenaReset(BlockArena* arena);
+
+#define K_BLOCK_ARENA_ALLOC(arena, t, count) (t *)blockArenaAlignedAlloc((arena), sizeof(t) * (count))
+
+//----------------------------------------------------------------------------------------------------------------------
+// Concurrent arena allocator
+// A concurrent arena is a reserved address range that any number of threads can allocate from at once, so parallel
+// producers can build their output in one contiguous region.  Space is claimed with an atomic add on the cursor and
+// pages are committed in K_CONCURRENT_ARENA_COMMIT_SIZE steps as the cursor reaches them.  Memory never moves.
+//
+// Each thread should allocate through a ConcurrentArenaCache of its own.  A cache claims a chunk of the arena at a
+// time and hands allocations out of it without touching the shared cursor; the unused end of its last chunk is
+// wasted.  There are no restore points, but concurrentArenaReset deallocates everything once the threads are done.
+//----------------------------------------------------------------------------------------------------------------------
+
+typedef struct
+{
+    volatile i64    cursor;         // Bytes claimed.  Can run past reserved once the arena is full.
+    u8              pad0[K_CACHE_LINE_SIZE - sizeof(i64)];
+
+    volatile i64    committed;      // Bytes committed.
+    u8*             start;
+    i64             reserved;
+    i64             chunkSize;
+#if OS_WIN32
+    SRWLOCK         commitLock;
+#endif
+}
+ConcurrentArena;
+
+typedef struct
+{
+    ConcurrentArena*    arena;
+    u8*                 cursor;     // Next free byte in the current chunk.
+    u8*                 end;
+}
+ConcurrentArenaCache;
+
+// Reserve an address range for a concurrent arena.  Caches claim chunkSize bytes at a time; if it is 0,
+// K_CONCURRENT_ARENA_CHUNK_SIZE is used.
+void concurrentArenaInit(ConcurrentArena* arena, i64 reserveSize, i64 chunkSize);
+
+// Release the arena's memory.  No threads can be using it.
+void concurrentArenaDone(ConcurrentArena* arena);
+
+// Allocate memory aligned to K_ARENA_ALIGN straight from the shared cursor.  Thread-safe.  Returns 0 if the arena is
+// full.
+void* concurrentArenaAlloc(ConcurrentArena* arena, i64 numBytes);
+
+// Number of bytes claimed from the arena, including the unused ends of chunks.
+i64 concurrentArenaUsed(const ConcurrentArena* arena);
+
+// Deallocate everything, keeping the pages committed for reuse.  No threads can be using the arena and every cache
+// must be initialised again.
+void concurrentArenaReset(ConcurrentArena* arena);
+
+// Initialise a cache for one thread to allocate from an arena with.
+void concurrentArenaCacheInit(ConcurrentArenaCache* cache, ConcurrentArena* arena);
+
+// Allocate memory aligned to K_ARENA_ALIGN through a cache.  Allocations bigger than half a chunk go straight to the
+// arena.  Only the thread that owns the cache can use it.  Returns 0 if the arena is full.
+void* concurrentArenaCacheAlloc(ConcurrentArenaCache* cache, i64 numBytes);
+
+#define K_CONCURRENT_ARENA_ALLOC(cache, t, count) (t *)concurrentArenaCacheAlloc((cache), sizeof(t) * (count))
+
+//----------------------------------------------------------------------------------------------------------------------
+// Scratch arenas
+// Each thread has a small pool of virtual arenas for temporary allocations.  A scratch scope hands one out with a
+// restore point pushed; ending the scope pops it.  No locks or heap allocations are involved once a thread's arenas
+// have been created.
+//
+// When a function builds its result on an arena passed in by its caller, pass that arena as the conflict so that
+// the scratch arena is a different one:
+//
+//      String f(Arena* arena)
+//      {
+//          Scratch scratch = scratchBegin(arena);
+//          ... temporary work on scratch.arena, result on arena ...
+//          scratchEnd(scratch);
+//      }
+//----------------------------------------------------------------------------------------------------------------------
+
+typedef struct
+{
+    Arena*  arena;
+}
+Scratch;
+
+// Begin a temporary scope on one of the calling thread's scratch arenas that is not the conflict arena (can be 0).
+// The scope's arena is 0 if the address range for a new scratch arena could not be reserved or the arena is out of
+// memory.
+Scratch scratchBegin(Arena* conflict);
+
+// Same as scratchBegin but avoids several arenas.  There must be fewer conflicts than K_SCRATCH_COUNT.
+Scratch scratchBeginConflicts(Arena** conflicts, int numConflicts);
+
+// End a temporary scope, deallocating everything allocated on the scratch arena since it began.
+void scratchEnd(Scratch scratch);
+
+// Release the calling thread's scratch arenas.  Call this before a thread that used scratch arenas exits.
+void scratchDone();
 
 //----------------------------------------------------------------------------------------------------------------------
 // Arrays
@@ -76,7 +410,7 @@ void arenaPop(Arena* arena);
 #define K_ARRAY_COUNT(a) (sizeof(a) / sizeof((a)[0]))
 
 // Destroy an array
-#define arrayRelease(a) ((a) ? K_FREE((u8 *)a - (sizeof(i64) * 2), (sizeof(*a) * __arrayCapacity(a)) + (sizeof(i64) * 2)), 0 : 0)
+#define arrayRelease(a) ((a) ? __arrayInternalRelease((a), sizeof(*(a)), __FILE__, __LINE__), 0 : 0)
 
 // Add an element to the end of an array
 #define arrayAdd(a, v) (__arrayMayGrow(a, 1), (a)[__arrayCount(a)++] = (v))
@@ -90,25 +424,244 @@ void arenaPop(Arena* arena);
 // Reserve capacity for n extra items to the array
 #define arrayReserve(a, n) (__arrayMayGrow(a, n))
 
+// Reserve capacity for n extra items and move the array to memory backed by large (2MB) pages.  The array stays in
+// large pages as it grows.  Falls back to normal pages if the process is not allowed large pages.
+#define arrayReserveHuge(a, n) ((a) = __arrayInternalReserve((a), arrayCount(a) + (n), sizeof(*(a)), K_ARRAY_HUGE, 0, __FILE__, __LINE__))
+
+// Reserve capacity for n extra items and move the array onto an arena.  From then on the array grows on the arena:
+// in place if it is the last allocation on the arena, otherwise by copying.  The memory is reclaimed by arenaPop
+// (or arenaDone).  arrayRelease only gives the memory back if the array is the last allocation on the arena.  A heap
+// arena moves when it grows, invalidating any other arrays on it, so use a virtual arena for more than one array.
+#define arrayReserveArena(a, arena, n) ((a) = __arrayInternalReserve((a), arrayCount(a) + (n), sizeof(*(a)), K_ARRAY_ARENA, (arena), __FILE__, __LINE__))
+
+// Reserve capacity for n extra items and make sure the elements are aligned to a power of two number of bytes.  The
+// array keeps its alignment as it grows or moves to another kind of storage.
+#define arrayReserveAligned(a, n, alignment) ((a) = __arrayInternalReserveAligned((a), arrayCount(a) + (n), sizeof(*(a)), (alignment), __FILE__, __LINE__))
+
+// Reserve capacity for n extra items and move the array to virtual memory committed on a NUMA node (or
+// K_NUMA_CURRENT).  The array stays on that node as it grows.
+#define arrayReserveNuma(a, n, node) ((a) = __arrayInternalReserveNuma((a), arrayCount(a) + (n), sizeof(*(a)), (node), __FILE__, __LINE__))
+
 // Clear the array
-#define arrayClear(a) (arrayCount(a) = 0)
+#define arrayClear(a) ((a) ? __arrayCount(a) = 0 : 0)
 
 // Delete an array entry
 #define arrayDelete(a, i) (memoryMove(&(a)[(i)+1], &(a)[(i)], (__arrayCount(a) - (i) - 1) * sizeof(*a)), --__arrayCount(a), (a))
 
+// Delete an array entry in O(1) by moving the last entry into its place.  Does not keep the order of the entries.
+#define arrayDeleteSwap(a, i) ((a)[(i)] = (a)[__arrayCount(a) - 1], --__arrayCount(a), (a))
+
+// Delete n entries starting at index i
+#define arrayDeleteRange(a, i, n) (memoryMove(&(a)[(i)+(n)], &(a)[(i)], (__arrayCount(a) - (i) - (n)) * sizeof(*a)), __arrayCount(a) -= (n), (a))
+
+// Insert n uninitialised entries before index i and return a pointer to the first one
+#define arrayInsert(a, i, n) (__arrayMayGrow(a, n), memoryMove(&(a)[(i)], &(a)[(i)+(n)], (__arrayCount(a) - (i)) * sizeof(*a)), __arrayCount(a) += (n), &(a)[(i)])
+
+// Add n elements copied from p to the end of an array.  p must not point into the array.
+#define arrayAppend(a, p, n) ((n) ? memoryCopy((p), arrayExpand(a, n), (n) * sizeof(*(a))), 0 : 0)
+
+// Add all the elements of array b to the end of array a.  They must not be the same array.
+#define arrayAppendArray(a, b) arrayAppend(a, b, arrayCount(b))
+
+// Delete every entry that the predicate returns YES for, keeping the order of the rest.  The predicate is called once
+// for each entry in order and the entries that are kept are moved down a run at a time, so this is O(n) rather than
+// the O(n^2) of calling arrayDelete in a loop.  Evaluates to the number of entries deleted.
+#define arrayRemoveIf(a, pred, context) (arrayCount(a) ? __arrayInternalRemoveIf((a), sizeof(*(a)), (pred), (context)) : 0)
+
+// Reduce the capacity of an array to its count, giving back the memory that is not used.  Arrays in large pages do
+// not shrink, and arrays on an arena only give memory back if they are the last allocation on it.
+#define arrayShrink(a) ((a) ? (a) = __arrayInternalShrink((a), sizeof(*(a)), __FILE__, __LINE__) : 0)
+
+// Predicate for arrayRemoveIf
+typedef bool (*ArrayPredicate)(const void* elem, void* context);
+
 //
 // Internal routines
 //
 
-#define __arrayRaw(a) ((i64 *)(a) - 2)
-#define __arrayCount(a) __arrayRaw(a)[1]
-#define __arrayCapacity(a) __arrayRaw(a)[0]
+typedef struct
+{
+    i64     storage;        // How the memory was allocated (K_ARRAY_HEAP etc.), log2 of any alignment << 8 and
+                            // any NUMA node + 1 << 16
+    union
+    {
+        i64     size;       // Number of bytes allocated for huge and virtual storage
+        Arena*  arena;      // Arena for arena storage
+    };
+    i64     capacity;
+    i64     count;
+}
+ArrayHeader;
+
+#define K_ARRAY_HEAP        0       // Allocated with K_REALLOC.
+#define K_ARRAY_HUGE        1       // Large pages.  size is the number of bytes allocated.
+#define K_ARRAY_VIRTUAL     2       // Reserved address range committed as it grows.  size is the number of bytes reserved.
+#define K_ARRAY_ARENA       3       // Allocated on an arena.
+
+#define K_ARRAY_KIND(storage) ((storage) & 0xff)
+#define K_ARRAY_NUMA_NODE(storage) (((storage) >> 16) - 1)
+
+#define __arrayHeader(a) ((ArrayHeader *)(a) - 1)
+#define __arrayCount(a) __arrayHeader(a)->count
+#define __arrayCapacity(a) __arrayHeader(a)->capacity
 
 #define __arrayNeedsToGrow(a, n) ((a) == 0 || __arrayCount(a) + (n) >= __arrayCapacity(a))
 #define __arrayMayGrow(a, n) (__arrayNeedsToGrow(a, (n)) ? __arrayGrow(a, n) : 0)
-#define __arrayGrow(a, n) ((a) = __arrayInternalGrow((a), (n), sizeof(*(a))))
+#define __arrayGrow(a, n) ((a) = __arrayInternalGrow((a), (n), sizeof(*(a)), __FILE__, __LINE__))
+
+internal void* __arrayInternalGrow(void* a, i64 increment, i64 elemSize, const char* file, int line);
+internal void* __arrayInternalResize(void* a, i64 capacity, i64 elemSize, i64 storage, Arena* arena,
+    const char* file, int line);
+internal void __arrayInternalRelease(void* a, i64 elemSize, const char* file, int line);
+internal void* __arrayInternalReserve(void* a, i64 capacity, i64 elemSize, i64 storage, Arena* arena,
+    const char* file, int line);
+internal void* __arrayInternalReserveAligned(void* a, i64 capacity, i64 elemSize, i64 alignment,
+    const char* file, int line);
+internal void* __arrayInternalReserveNuma(void* a, i64 capacity, i64 elemSize, i64 node, const char* file, int line);
+internal i64 __arrayInternalRemoveIf(void* a, i64 elemSize, ArrayPredicate pred, void* context);
+internal void* __arrayInternalShrink(void* a, i64 elemSize, const char* file, int line);
+
+//----------------------------------------------------------------------------------------------------------------------
+// Slot maps
+//
+// A slot map stores its elements densely in an array and hands out handles to them.  A handle holds a slot index in
+// its low 32 bits and that slot's generation in its high 32 bits.  The slot holds the element's position in the
+// dense array.  Removing an element bumps the generation of its slot, so any old handles to it are seen as stale.
+//
+// Removal moves the last element into the gap to keep the array packed, so pointers to elements are only valid
+// until the next add or remove.  Iterate with slotMapCount and slotMapAt.  A handle of 0 is never valid.
+//----------------------------------------------------------------------------------------------------------------------
+
+typedef u64 Handle;
+
+typedef struct
+{
+    u32     index;          // Position of the element in the dense array, or the next free slot.
+    u32     generation;
+}
+SlotMapSlot;
+
+typedef struct
+{
+    Array(u8)           data;       // Dense element storage.
+    Array(u32)          owners;     // Slot index of each element in the dense array.
+    Array(SlotMapSlot)  slots;
+    i64                 elemSize;
+    u32                 freeSlot;   // First free slot, or K_SLOTMAP_NONE.
+}
+SlotMap;
+
+// Initialise an empty slot map.
+void slotMapInit(SlotMap* map, i64 elemSize);
+
+// Release all memory used by the slot map.
+void slotMapDone(SlotMap* map);
+
+// Add an uninitialised element and return a pointer to it.  Its handle is written to handle.
+void* slotMapAdd(SlotMap* map, Handle* handle);
+
+// Remove an element.  Returns NO if the handle is stale.
+bool slotMapRemove(SlotMap* map, Handle handle);
+
+// Return the element for a handle, or 0 if the handle is stale.
+void* slotMapGet(const SlotMap* map, Handle handle);
+
+// Number of elements in the slot map.
+i64 slotMapCount(const SlotMap* map);
+
+// Return the element, or its handle, at a position in the dense array.
+void* slotMapAt(const SlotMap* map, i64 i);
+Handle slotMapHandleAt(const SlotMap* map, i64 i);
+
+#define K_SLOTMAP_INIT(map, t) slotMapInit((map), sizeof(t))
+#define K_SLOTMAP_ADD(map, t, handle) ((t *)slotMapAdd((map), (handle)))
+#define K_SLOTMAP_GET(map, handle, t) ((t *)slotMapGet((map), (handle)))
+#define K_SLOTMAP_AT(map, i, t) ((t *)slotMapAt((map), (i)))
+
+//----------------------------------------------------------------------------------------------------------------------
+// Struct of arrays
+//
+// Declares a container that keeps each field of a record in its own column.  The fields are listed with an X-macro:
+//
+//      #define PARTICLE_FIELDS(X) \
+//          X(f32, x) \
+//          X(f32, y) \
+//          X(u32, colour)
+//
+//      K_SOA(Particles, PARTICLE_FIELDS);
+//
+//      Particles p;
+//      soaInit(Particles, &p);
+//      i64 i = soaAdd(&p);
+//      p.x[i] = 1.0f;
+//
+// All the columns live in one allocation and share a count and capacity, so they grow in a single step.  Each column
+// starts on a K_CACHE_LINE_SIZE boundary and is padded to a multiple of it, so SIMD loops can use aligned loads and
+// run over the end of a column up to the next boundary.  Column pointers change when the container grows.
+//----------------------------------------------------------------------------------------------------------------------
+
+typedef struct
+{
+    i64         count;
+    i64         capacity;
+    i64         numColumns;
+    const i64*  sizes;          // Element size of each column.
+    u8*         block;          // Memory for all the columns.
+    i64         blockSize;
+}
+SoaHeader;
+
+#define __K_SOA_FIELD(t, name) t* name;
+#define __K_SOA_COUNT(t, name) + 1
+#define __K_SOA_SIZE(t, name) sizeof(t),
+
+// Declare a struct of arrays type called T.  The column pointers directly follow the header.
+#define K_SOA(T, FIELDS) \
+    typedef struct \
+    { \
+        SoaHeader soa; \
+        union \
+        { \
+            struct { FIELDS(__K_SOA_FIELD) }; \
+            void* columns[0 FIELDS(__K_SOA_COUNT)]; \
+        }; \
+    } \
+    T; \
+    static const i64 __##T##ColumnSizes[] = { FIELDS(__K_SOA_SIZE) }
+
+// Initialise an empty container of type T
+#define soaInit(T, s) __soaInit(&(s)->soa, __##T##ColumnSizes, sizeof(__##T##ColumnSizes) / sizeof(i64))
+
+// Release the container's memory
+#define soaDone(s) __soaDone(&(s)->soa)
+
+// Return the number of records
+#define soaCount(s) ((s)->soa.count)
+
+// Reserve capacity for n extra records.  Returns NO if the memory could not be allocated.
+#define soaReserve(s, n) __soaReserve(&(s)->soa, (s)->soa.count + (n))
+
+// Add an uninitialised record and return its index, or -1 if the memory could not be allocated
+#define soaAdd(s) __soaExpand(&(s)->soa, 1)
+
+// Add n uninitialised records and return the index of the first one, or -1 if the memory could not be allocated
+#define soaExpand(s, n) __soaExpand(&(s)->soa, (n))
+
+// Delete a record, keeping the others in order
+#define soaDelete(s, i) __soaDelete(&(s)->soa, (i))
+
+// Delete a record by moving the last record into its place
+#define soaDeleteSwap(s, i) __soaDeleteSwap(&(s)->soa, (i))
+
+// Remove all records
+#define soaClear(s) ((s)->soa.count = 0)
 
-internal void* __arrayInternalGrow(void* a, i64 increment, i64 elemSize);
+internal void __soaInit(SoaHeader* soa, const i64* sizes, i64 numColumns);
+internal void __soaDone(SoaHeader* soa);
+internal bool __soaReserve(SoaHeader* soa, i64 capacity);
+internal i64 __soaExpand(SoaHeader* soa, i64 n);
+internal void __soaDelete(SoaHeader* soa, i64 i);
+internal void __soaDeleteSwap(SoaHeader* soa, i64 i);
 
 //----------------------------------------------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------------------------------------------
@@ -117,181 +670,2410 @@ internal void* __arrayInternalGrow(void* a, i64 increment, i64 elemSize);
 
 #ifdef K_IMPLEMENTATION
 
+#if COMPILER_MSVC
+#   include <intrin.h>
+#endif
+
 //----------------------------------------------------------------------------------------------------------------------
 // Basic allocation
 //----------------------------------------------------------------------------------------------------------------------
 
-internal void* memoryOp(void* oldAddress, i64 oldNumBytes, i64 newNumBytes, const char* file, int line)
-{
-    void* p = 0;
+#if K_MEMORY_SLAB
 
-    if (newNumBytes)
-    {
-        p = realloc(oldAddress, newNumBytes);
-    }
-    else
-    {
-        free(oldAddress);
-    }
+//
+// Size-class slab allocator
+//
+// Because every free and realloc is told the size of the block, blocks need no header: the size class is worked
+// out from the size.  Sizes up to 128 bytes are rounded up to 16 bytes, and after that there are 4 classes per
+// power of two up to K_SLAB_MAX_SIZE.  Slots are carved from K_SLAB_SPAN_SIZE spans of virtual memory.  Each thread
+// keeps a free list per class and only takes a lock to move a batch of slots to or from the global list.  Larger
+// blocks go straight to the OS.
+//
 
-    return p;
-}
+#define K_SLAB_MAX_SIZE         KB(32)
+#define K_SLAB_NUM_CLASSES      40
+#define K_SLAB_SPAN_SIZE        KB(256)
+#define K_SLAB_NEXT(slot)       (*(void **)(slot))
 
-void* memoryAlloc(i64 numBytes, const char* file, int line)
+typedef struct
 {
-    return memoryOp(0, 0, numBytes, file, line);
+    void*       freeList;
+    u8*         cursor;
+    u8*         end;
+#if OS_WIN32
+    SRWLOCK     lock;
+#endif
 }
+SlabClass;
 
-void* memoryRealloc(void* address, i64 oldNumBytes, i64 newNumBytes, const char* file, int line)
+typedef struct
 {
-    return memoryOp(address, oldNumBytes, newNumBytes, file, line);
+    void*       freeList;
+    i64         count;
 }
+SlabCache;
 
-void memoryFree(void* address, i64 numBytes, const char* file, int line)
+SlabClass gSlabClasses[K_SLAB_NUM_CLASSES];
+K_THREAD_LOCAL SlabCache gSlabCaches[K_SLAB_NUM_CLASSES];
+
+internal int __slabClass(i64 size)
 {
-    memoryOp(address, numBytes, 0, file, line);
+    unsigned long p;
+
+    if (size <= 128) return (int)((size + 15) >> 4) - 1;
+
+    // Sizes here are at most K_SLAB_MAX_SIZE so a 32-bit scan is enough, and works on 32-bit CPUs too
+    _BitScanReverse(&p, (u32)(size - 1));
+    return 8 + ((int)p - 7) * 4 + (int)((size - 1 - ((i64)1 << p)) >> (p - 2));
 }
 
-void memoryCopy(const void* src, void* dst, i64 numBytes)
+internal i64 __slabClassSize(int c)
 {
-    memcpy(dst, src, (size_t)numBytes);
+    int p = 7 + (c - 8) / 4;
+    return c < 8 ? (c + 1) * 16 : ((i64)1 << p) + ((c - 8) % 4 + 1) * ((i64)1 << (p - 2));
 }
 
-void memoryMove(const void* src, void* dst, i64 numBytes)
+internal i64 __slabBatchSize(int c)
 {
-    memmove(dst, src, (size_t)numBytes);
+    return K_MAX(K_MIN(K_SLAB_CACHE_BYTES / __slabClassSize(c) / 2, 64), 2);
 }
 
-int memoryCompare(const void* mem1, const void* mem2, i64 numBytes)
+internal void* __slabOsAlloc(i64 numBytes)
 {
-    return memcmp(mem1, mem2, (size_t)numBytes);
+#if OS_WIN32
+    return VirtualAlloc(0, (SIZE_T)numBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+#   error Implement __slabOsAlloc for your OS.
+#endif
 }
 
-void memoryClear(void* mem, i64 numBytes)
+internal void __slabOsFree(void* address, i64 numBytes)
 {
-    memset(mem, 0, (size_t)numBytes);
+#if OS_WIN32
+    VirtualFree(address, 0, MEM_RELEASE);
+#endif
 }
 
-//----------------------------------------------------------------------------------------------------------------------
-// Arena control
-//----------------------------------------------------------------------------------------------------------------------
-
-void arenaInit(Arena* arena, i64 initialSize)
+// Move a batch of slots from the global list of a size class into the thread's cache.
+internal void __slabRefill(int c)
 {
-    u8* buffer = (u8 *)malloc(initialSize);
-    if (buffer)
+    SlabClass* sc = &gSlabClasses[c];
+    SlabCache* cache = &gSlabCaches[c];
+    i64 size = __slabClassSize(c);
+    i64 batch = __slabBatchSize(c);
+
+    AcquireSRWLockExclusive(&sc->lock);
+    for (i64 i = 0; i < batch; ++i)
     {
-        arena->start = buffer;
-        arena->end = arena->start + initialSize;
-        arena->cursor = 0;
-        arena->restore = -1;
+        void* slot = sc->freeList;
+
+        if (slot)
+        {
+            sc->freeList = K_SLAB_NEXT(slot);
+        }
+        else
+        {
+            if (sc->cursor + size > sc->end)
+            {
+                u8* span = (u8 *)__slabOsAlloc(K_SLAB_SPAN_SIZE);
+                if (!span) break;
+                sc->cursor = span;
+                sc->end = span + K_SLAB_SPAN_SIZE;
+            }
+            slot = sc->cursor;
+            sc->cursor += size;
+        }
+
+        K_SLAB_NEXT(slot) = cache->freeList;
+        cache->freeList = slot;
+        ++cache->count;
     }
+    ReleaseSRWLockExclusive(&sc->lock);
 }
 
-void arenaDone(Arena* arena)
+// Move up to numSlots slots from the thread's cache back to the global list of a size class.
+internal void __slabFlush(int c, i64 numSlots)
 {
-    free(arena->start);
-    arena->start = 0;
-    arena->end = 0;
-    arena->cursor = 0;
-    arena->restore = -1;
+    SlabClass* sc = &gSlabClasses[c];
+    SlabCache* cache = &gSlabCaches[c];
+    void* first = cache->freeList;
+    void* last = first;
+
+    if (!first || numSlots <= 0) return;
+
+    for (i64 i = 1; i < numSlots && K_SLAB_NEXT(last); ++i)
+    {
+        last = K_SLAB_NEXT(last);
+        --cache->count;
+    }
+    --cache->count;
+    cache->freeList = K_SLAB_NEXT(last);
+
+    AcquireSRWLockExclusive(&sc->lock);
+    K_SLAB_NEXT(last) = sc->freeList;
+    sc->freeList = first;
+    ReleaseSRWLockExclusive(&sc->lock);
 }
 
-void* arenaAlloc(Arena* arena, i64 size)
+internal void* __slabAlloc(i64 numBytes)
 {
-    void* p = 0;
-    if ((arena->start + arena->cursor + size) > arena->end)
-    {
-        // We don't have enough room
-        i64 currentSize = (i64)(arena->end - (u8 *)arena);
-        i64 requiredSize = currentSize + size;
-        i64 newSize = currentSize + K_MAX(requiredSize, K_ARENA_INCREMENT);
+    int c;
+    SlabCache* cache;
+    void* slot;
 
-        u8* newArena = (u8 *)realloc(arena, newSize);
+    if (numBytes > K_SLAB_MAX_SIZE) return __slabOsAlloc(numBytes);
 
-        if (newArena)
-        {
-            arena->start = newArena;
-            arena->end = newArena + newSize;
+    c = __slabClass(numBytes);
+    cache = &gSlabCaches[c];
+    if (!cache->freeList) __slabRefill(c);
 
-            // Try again!
-            p = arenaAlloc(arena, size);
-        }
-    }
-    else
+    slot = cache->freeList;
+    if (slot)
     {
-        p = arena->start + arena->cursor;
-        arena->cursor += size;
+        cache->freeList = K_SLAB_NEXT(slot);
+        --cache->count;
     }
 
-    return p;
+    return slot;
 }
 
-void* arenaAlign(Arena* arena)
+internal void __slabFree(void* address, i64 numBytes)
+{
+    int c;
+    SlabCache* cache;
+
+    if (numBytes > K_SLAB_MAX_SIZE)
+    {
+        __slabOsFree(address, numBytes);
+        return;
+    }
+
+    c = __slabClass(numBytes);
+    cache = &gSlabCaches[c];
+    K_SLAB_NEXT(address) = cache->freeList;
+    cache->freeList = address;
+    if (++cache->count > 2 * __slabBatchSize(c))
+    {
+        __slabFlush(c, __slabBatchSize(c));
+    }
+}
+
+internal void* __memoryOp(void* oldAddress, i64 oldNumBytes, i64 newNumBytes)
+{
+    void* p = 0;
+
+    if (oldAddress && newNumBytes &&
+        oldNumBytes <= K_SLAB_MAX_SIZE && newNumBytes <= K_SLAB_MAX_SIZE &&
+        __slabClass(oldNumBytes) == __slabClass(newNumBytes))
+    {
+        // Still fits in the same slot
+        return oldAddress;
+    }
+
+    if (newNumBytes)
+    {
+        p = __slabAlloc(newNumBytes);
+        if (!p) return 0;
+        if (oldAddress) memcpy(p, oldAddress, (size_t)K_MIN(oldNumBytes, newNumBytes));
+    }
+
+    if (oldAddress) __slabFree(oldAddress, oldNumBytes);
+
+    return p;
+}
+
+void memoryThreadDone()
+{
+    for (int c = 0; c < K_SLAB_NUM_CLASSES; ++c)
+    {
+        __slabFlush(c, gSlabCaches[c].count);
+    }
+}
+
+#undef K_SLAB_NEXT
+
+#else
+
+internal void* __memoryOp(void* oldAddress, i64 oldNumBytes, i64 newNumBytes)
+{
+    void* p = 0;
+
+    if (newNumBytes)
+    {
+        p = realloc(oldAddress, newNumBytes);
+    }
+    else
+    {
+        free(oldAddress);
+    }
+
+    return p;
+}
+
+void memoryThreadDone()
+{
+}
+
+#endif // K_MEMORY_SLAB
+
+#if K_MEMORY_TRACKING
+
+//
+// Call-site tracking
+//
+// Every block is given a small header that points to the call site that allocated it, so frees and reallocs can
+// be charged back to the right site.  Sites live in a fixed-size open-addressed table keyed on file and line.
+// Slots are claimed with a compare-and-swap and all counters are updated with interlocked operations, so no locks
+// are taken.  The 64-bit counters use the Windows Interlocked*64 functions rather than the intrinsics, which only
+// exist on 64-bit CPUs.  Histogram bucket i counts allocations of 2^i to 2^(i+1)-1 bytes.
+//
+
+#define K_MEMORY_HISTOGRAM_SIZE 32
+
+typedef struct
+{
+    const char* volatile    file;
+    volatile i64            line;
+    volatile i64            liveBytes;
+    volatile i64            peakBytes;
+    volatile i64            liveCount;
+    volatile i64            numAllocs;
+    volatile i64            histogram[K_MEMORY_HISTOGRAM_SIZE];
+}
+MemorySite;
+
+typedef struct
+{
+    MemorySite*     site;
+    i64             size;
+}
+MemoryTrackHeader;
+
+MemorySite gMemorySites[K_MEMORY_TRACKING_SITES];
+MemorySite gMemoryUnknownSite = { "<unknown>", 0 };
+volatile i64 gMemoryTrackingStarted = 0;
+
+internal MemorySite* __memoryFindSite(const char* file, int line)
+{
+    u64 h = ((u64)(uintptr_t)file * 31 + (u64)line) * 0x9e3779b97f4a7c15ull;
+    i64 index = (i64)(h >> 32) & (K_MEMORY_TRACKING_SITES - 1);
+
+    for (i64 i = 0; i < K_MEMORY_TRACKING_SITES; ++i)
+    {
+        MemorySite* site = &gMemorySites[(index + i) & (K_MEMORY_TRACKING_SITES - 1)];
+        const char* siteFile = site->file;
+
+        if (!siteFile)
+        {
+            siteFile = (const char *)_InterlockedCompareExchangePointer((void* volatile *)&site->file, (void *)file, 0);
+            if (!siteFile)
+            {
+                // We claimed this slot
+                site->line = line;
+                return site;
+            }
+        }
+
+        if (siteFile == file)
+        {
+            // Another thread may have just claimed the slot and not written the line yet
+            while (site->line == 0) _ReadWriteBarrier();
+            if (site->line == line) return site;
+        }
+    }
+
+    // Table is full
+    return &gMemoryUnknownSite;
+}
+
+internal void __memoryTrackAlloc(MemorySite* site, i64 numBytes)
+{
+    i64 live = InterlockedExchangeAdd64(&site->liveBytes, numBytes) + numBytes;
+    i64 peak = site->peakBytes;
+    unsigned long bucket = 0;
+
+    while (live > peak)
+    {
+        i64 oldPeak = _InterlockedCompareExchange64(&site->peakBytes, live, peak);
+        if (oldPeak == peak) break;
+        peak = oldPeak;
+    }
+
+    // Sizes of 2^31 bytes or more all land in the last bucket, so a 32-bit scan is enough
+    _BitScanReverse(&bucket, (u32)K_MIN(numBytes, (i64)0xffffffff) | 1);
+    InterlockedIncrement64(&site->liveCount);
+    InterlockedIncrement64(&site->numAllocs);
+    InterlockedIncrement64(&site->histogram[K_MIN(bucket, K_MEMORY_HISTOGRAM_SIZE - 1)]);
+}
+
+internal void __memoryTrackFree(MemorySite* site, i64 numBytes)
+{
+    InterlockedExchangeAdd64(&site->liveBytes, -numBytes);
+    InterlockedDecrement64(&site->liveCount);
+}
+
+internal void __memoryReportLeaksAtExit(void)
+{
+    memoryReportLeaks();
+}
+
+internal void* memoryOp(void* oldAddress, i64 oldNumBytes, i64 newNumBytes, const char* file, int line)
+{
+    MemoryTrackHeader* hdr = oldAddress ? (MemoryTrackHeader *)oldAddress - 1 : 0;
+    MemoryTrackHeader* newHdr = 0;
+
+    if (!gMemoryTrackingStarted && _InterlockedCompareExchange64(&gMemoryTrackingStarted, 1, 0) == 0)
+    {
+        atexit(&__memoryReportLeaksAtExit);
+    }
+
+    if (hdr)
+    {
+        K_ASSERT(hdr->size == oldNumBytes, "Freeing or reallocating a block with the wrong size");
+        __memoryTrackFree(hdr->site, oldNumBytes);
+    }
+
+    newHdr = (MemoryTrackHeader *)__memoryOp(hdr,
+        hdr ? oldNumBytes + sizeof(MemoryTrackHeader) : 0,
+        newNumBytes ? newNumBytes + sizeof(MemoryTrackHeader) : 0);
+
+    if (newHdr)
+    {
+        newHdr->site = __memoryFindSite(file, line);
+        newHdr->size = newNumBytes;
+        __memoryTrackAlloc(newHdr->site, newNumBytes);
+        return newHdr + 1;
+    }
+    else if (hdr && newNumBytes)
+    {
+        // Reallocation failed so the original block is still live
+        __memoryTrackAlloc(hdr->site, oldNumBytes);
+    }
+
+    return 0;
+}
+
+internal void __memoryReportSite(MemorySite* site)
+{
+    if (site->liveCount)
+    {
+        fprintf(stderr, "%s(%d): %lld bytes leaked in %lld allocations\n",
+            site->file, (int)site->line, site->liveBytes, site->liveCount);
+    }
+}
+
+void memoryReportLeaks()
+{
+    for (i64 i = 0; i < K_MEMORY_TRACKING_SITES; ++i)
+    {
+        if (gMemorySites[i].file) __memoryReportSite(&gMemorySites[i]);
+    }
+    __memoryReportSite(&gMemoryUnknownSite);
+}
+
+internal void __memoryDumpSite(FILE* f, MemorySite* site, bool first)
+{
+    fprintf(f, "%s\n  {\"file\": \"", first ? "" : ",");
+    for (const char* s = site->file; *s; ++s)
+    {
+        if (*s == '\\' || *s == '"') fputc('\\', f);
+        fputc(*s, f);
+    }
+    fprintf(f, "\", \"line\": %d, \"liveBytes\": %lld, \"peakBytes\": %lld, \"liveCount\": %lld, \"numAllocs\": %lld, "
+        "\"histogram\": [", (int)site->line, site->liveBytes, site->peakBytes, site->liveCount, site->numAllocs);
+    for (int i = 0; i < K_MEMORY_HISTOGRAM_SIZE; ++i)
+    {
+        fprintf(f, "%s%lld", i ? ", " : "", site->histogram[i]);
+    }
+    fprintf(f, "]}");
+}
+
+void memoryDumpJson(FILE* f)
+{
+    bool first = YES;
+
+    fprintf(f, "[");
+    for (i64 i = 0; i < K_MEMORY_TRACKING_SITES; ++i)
+    {
+        if (gMemorySites[i].file)
+        {
+            __memoryDumpSite(f, &gMemorySites[i], first);
+            first = NO;
+        }
+    }
+    if (gMemoryUnknownSite.numAllocs) __memoryDumpSite(f, &gMemoryUnknownSite, first);
+    fprintf(f, "\n]\n");
+}
+
+#else
+
+internal void* memoryOp(void* oldAddress, i64 oldNumBytes, i64 newNumBytes, const char* file, int line)
+{
+    return __memoryOp(oldAddress, oldNumBytes, newNumBytes);
+}
+
+void memoryReportLeaks()
+{
+}
+
+void memoryDumpJson(FILE* f)
+{
+}
+
+#endif // K_MEMORY_TRACKING
+
+internal i64 __memoryRoundUp(i64 numBytes, i64 granularity)
+{
+    return (numBytes + granularity - 1) / granularity * granularity;
+}
+
+//
+// Large pages
+//
+
+#if OS_WIN32
+#   pragma comment(lib, "advapi32.lib")
+#endif
+
+i64 gMemoryLargePageSize = -1;
+
+// Return the size of a large page, or 0 if the process is not allowed to use them.  The first call tries to enable
+// the privilege large pages need.
+internal i64 __memoryLargePageSize()
+{
+    if (gMemoryLargePageSize < 0)
+    {
+        i64 size = 0;
+
+#if OS_WIN32
+        HANDLE token;
+        if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        {
+            TOKEN_PRIVILEGES tp;
+            tp.PrivilegeCount = 1;
+            tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+            // AdjustTokenPrivileges succeeds even if the privilege was not granted, so check the last error too
+            if (LookupPrivilegeValueA(0, "SeLockMemoryPrivilege", &tp.Privileges[0].Luid) &&
+                AdjustTokenPrivileges(token, FALSE, &tp, 0, 0, 0) &&
+                GetLastError() == ERROR_SUCCESS)
+            {
+                size = (i64)GetLargePageMinimum();
+            }
+            CloseHandle(token);
+        }
+#endif
+
+        gMemoryLargePageSize = size;
+    }
+
+    return gMemoryLargePageSize;
+}
+
+// Allocate committed memory backed by large pages.  The size is rounded up to a whole number of large pages and
+// written back.  Returns 0 if large pages are not available.
+internal void* __memoryLargePageAlloc(i64* numBytes)
+{
+    i64 largePageSize = __memoryLargePageSize();
+    i64 size = 0;
+    void* p = 0;
+
+    if (largePageSize)
+    {
+        size = __memoryRoundUp(*numBytes, largePageSize);
+#if OS_WIN32
+        p = VirtualAlloc(0, (SIZE_T)size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+#else
+#   error Implement __memoryLargePageAlloc for your OS.
+#endif
+    }
+
+    if (p) *numBytes = size;
+    return p;
+}
+
+// Allocate committed memory backed by large pages if possible, otherwise by normal pages.  The size is rounded up
+// to a whole number of pages and written back.
+internal void* __memoryHugeAlloc(i64* numBytes)
+{
+    void* p = __memoryLargePageAlloc(numBytes);
+
+    if (!p)
+    {
+        i64 size = __memoryRoundUp(*numBytes, K_ARENA_COMMIT_SIZE);
+#if OS_WIN32
+        p = VirtualAlloc(0, (SIZE_T)size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#endif
+        if (p) *numBytes = size;
+    }
+
+    return p;
+}
+
+internal void __memoryHugeFree(void* address)
+{
+#if OS_WIN32
+    VirtualFree(address, 0, MEM_RELEASE);
+#endif
+}
+
+//
+// NUMA
+//
+
+i64 memoryNumaNode()
+{
+#if OS_WIN32
+    PROCESSOR_NUMBER processor;
+    USHORT node = 0;
+
+    GetCurrentProcessorNumberEx(&processor);
+    return GetNumaProcessorNodeEx(&processor, &node) ? (i64)node : 0;
+#else
+#   error Implement memoryNumaNode for your OS.
+#endif
+}
+
+i64 memoryNumaNodeCount()
+{
+#if OS_WIN32
+    ULONG highest = 0;
+    return GetNumaHighestNodeNumber(&highest) ? (i64)highest + 1 : 1;
+#else
+#   error Implement memoryNumaNodeCount for your OS.
+#endif
+}
+
+internal i64 __memoryNumaResolve(i64 node)
+{
+    return node == K_NUMA_CURRENT ? memoryNumaNode() : node;
+}
+
+// Reserve and/or commit pages on a NUMA node unless it is K_NUMA_NONE.  Reserving on a node makes it the preferred
+// node of every page committed in the range later, as well as the ones committed with it.
+internal void* __memoryVirtualAlloc(void* address, i64 numBytes, u32 type, u32 protect, i64 node)
+{
+#if OS_WIN32
+    return node >= 0
+        ? VirtualAllocExNuma(GetCurrentProcess(), address, (SIZE_T)numBytes, type, protect, (DWORD)node)
+        : VirtualAlloc(address, (SIZE_T)numBytes, type, protect);
+#else
+#   error Implement __memoryVirtualAlloc for your OS.
+#endif
+}
+
+void* memoryAlloc(i64 numBytes, const char* file, int line)
+{
+    return memoryOp(0, 0, numBytes, file, line);
+}
+
+void* memoryRealloc(void* address, i64 oldNumBytes, i64 newNumBytes, const char* file, int line)
+{
+    return memoryOp(address, oldNumBytes, newNumBytes, file, line);
+}
+
+void memoryFree(void* address, i64 numBytes, const char* file, int line)
+{
+    memoryOp(address, numBytes, 0, file, line);
+}
+
+//
+// Aligned allocation
+//
+// The block is over-allocated and the address of the original allocation is stored just before the aligned
+// address.  An offset can be given so that the address offset bytes into the block is aligned instead of the start,
+// which lets a header sit in front of aligned data.
+//
+
+internal void* __memoryAllocAligned(i64 numBytes, i64 alignment, i64 offset, const char* file, int line)
+{
+    u8* base = (u8 *)memoryOp(0, 0, numBytes + alignment + sizeof(void*), file, line);
+    u8* p = 0;
+
+    if (base)
+    {
+        uintptr_t aligned = ((uintptr_t)(base + sizeof(void*) + offset) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        p = (u8 *)aligned - offset;
+        ((void **)p)[-1] = base;
+    }
+
+    return p;
+}
+
+internal void __memoryFreeAligned(void* address, i64 numBytes, i64 alignment, const char* file, int line)
+{
+    if (address)
+    {
+        memoryOp(((void **)address)[-1], numBytes + alignment + sizeof(void*), 0, file, line);
+    }
+}
+
+void* memoryAllocAligned(i64 numBytes, i64 alignment, const char* file, int line)
+{
+    K_ASSERT((alignment & (alignment - 1)) == 0, "Alignment must be a power of two");
+    return alignment <= (i64)K_MEMORY_ALIGN
+        ? memoryOp(0, 0, numBytes, file, line)
+        : __memoryAllocAligned(numBytes, alignment, 0, file, line);
+}
+
+void* memoryReallocAligned(void* address, i64 oldNumBytes, i64 newNumBytes, i64 alignment, const char* file, int line)
+{
+    void* p = 0;
+
+    if (alignment <= (i64)K_MEMORY_ALIGN) return memoryOp(address, oldNumBytes, newNumBytes, file, line);
+
+    if (newNumBytes)
+    {
+        p = __memoryAllocAligned(newNumBytes, alignment, 0, file, line);
+        if (!p) return 0;
+        if (address) memoryCopy(address, p, K_MIN(oldNumBytes, newNumBytes));
+    }
+    __memoryFreeAligned(address, oldNumBytes, alignment, file, line);
+
+    return p;
+}
+
+void memoryFreeAligned(void* address, i64 numBytes, i64 alignment, const char* file, int line)
+{
+    if (alignment <= (i64)K_MEMORY_ALIGN)
+    {
+        memoryOp(address, numBytes, 0, file, line);
+    }
+    else
+    {
+        __memoryFreeAligned(address, numBytes, alignment, file, line);
+    }
+}
+
+//
+// CPU features
+//
+// The SIMD instruction sets that both the CPU and the OS support.  Memory, bitsets and b-trees all pick their kernels
+// from these.
+//
+
+#define K_MEMORY_CPU_AVX2       1
+#define K_MEMORY_CPU_AVX512     2
+
+// -1 = not checked yet, otherwise the K_MEMORY_CPU_* flags
+int gMemoryCpuFeatures = -1;
+
+// Return the K_MEMORY_CPU_* flags, checking the CPU the first time.  Several threads can race to do this but they
+// will all get the same answer.
+internal int __memoryCpuFeatures()
+{
+#if CPU_X86 || CPU_X64
+    if (gMemoryCpuFeatures < 0)
+    {
+        int info[4];
+        int features = 0;
+
+        __cpuid(info, 0);
+        if (info[0] >= 7)
+        {
+            u64 xcr0 = 0;
+
+            // OSXSAVE and AVX must be present before we can ask which registers the OS saves
+            __cpuid(info, 1);
+            if ((info[2] & (1 << 27)) && (info[2] & (1 << 28))) xcr0 = _xgetbv(0);
+
+            __cpuidex(info, 7, 0);
+            if ((xcr0 & 0x06) == 0x06 && (info[1] & (1 << 5))) features |= K_MEMORY_CPU_AVX2;
+            if ((xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16))) features |= K_MEMORY_CPU_AVX512;
+        }
+        gMemoryCpuFeatures = features;
+    }
+
+    return gMemoryCpuFeatures;
+#else
+    return 0;
+#endif
+}
+
+//
+// Copying and clearing
+//
+// Blocks of K_MEMORY_SIMD_MIN bytes or more are handled by AVX2 or AVX-512 kernels, picked on first use from what
+// the CPU and OS support.  Smaller blocks go to libc, which is hard to beat for them.  Blocks of at least the
+// streaming threshold are written with non-temporal stores so that copying or clearing a large buffer does not evict
+// everything else from the cache.
+//
+
+#define K_MEMORY_SIMD_MIN       256
+
+typedef void (*MemoryCopyFunc)(const void* src, void* dst, i64 numBytes);
+typedef void (*MemoryClearFunc)(void* mem, i64 numBytes);
+
+i64 gMemoryStreamingThreshold = K_MEMORY_STREAMING_THRESHOLD;
+
+internal void __memoryCopyLibc(const void* src, void* dst, i64 numBytes)
+{
+    memcpy(dst, src, (size_t)numBytes);
+}
+
+internal void __memoryClearLibc(void* mem, i64 numBytes)
+{
+    memset(mem, 0, (size_t)numBytes);
+}
+
+#if CPU_X86 || CPU_X64
+
+#include <immintrin.h>
+
+// The first 32 bytes are stored unaligned, then the destination is aligned for the bulk of the work.  The last 32
+// bytes are stored unaligned too, overlapping what was already written if necessary.
+internal void __memoryCopyAvx2(const void* src, void* dst, i64 numBytes)
+{
+    const u8* s = (const u8 *)src;
+    u8* d = (u8 *)dst;
+    const u8* lastSrc = s + numBytes - 32;
+    u8* lastDst = d + numBytes - 32;
+    i64 skip = 32 - (i64)((uintptr_t)d & 31);
+
+    if (numBytes < K_MEMORY_SIMD_MIN)
+    {
+        memcpy(dst, src, (size_t)numBytes);
+        return;
+    }
+
+    _mm256_storeu_si256((__m256i *)d, _mm256_loadu_si256((const __m256i *)s));
+    s += skip;
+    d += skip;
+    numBytes -= skip;
+
+    if (numBytes >= gMemoryStreamingThreshold)
+    {
+        for (; numBytes >= 128; numBytes -= 128, s += 128, d += 128)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)s + 0);
+            __m256i b = _mm256_loadu_si256((const __m256i *)s + 1);
+            __m256i c = _mm256_loadu_si256((const __m256i *)s + 2);
+            __m256i e = _mm256_loadu_si256((const __m256i *)s + 3);
+            _mm256_stream_si256((__m256i *)d + 0, a);
+            _mm256_stream_si256((__m256i *)d + 1, b);
+            _mm256_stream_si256((__m256i *)d + 2, c);
+            _mm256_stream_si256((__m256i *)d + 3, e);
+        }
+        _mm_sfence();
+    }
+    else
+    {
+        for (; numBytes >= 128; numBytes -= 128, s += 128, d += 128)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)s + 0);
+            __m256i b = _mm256_loadu_si256((const __m256i *)s + 1);
+            __m256i c = _mm256_loadu_si256((const __m256i *)s + 2);
+            __m256i e = _mm256_loadu_si256((const __m256i *)s + 3);
+            _mm256_store_si256((__m256i *)d + 0, a);
+            _mm256_store_si256((__m256i *)d + 1, b);
+            _mm256_store_si256((__m256i *)d + 2, c);
+            _mm256_store_si256((__m256i *)d + 3, e);
+        }
+    }
+
+    for (; numBytes >= 32; numBytes -= 32, s += 32, d += 32)
+    {
+        _mm256_store_si256((__m256i *)d, _mm256_loadu_si256((const __m256i *)s));
+    }
+    _mm256_storeu_si256((__m256i *)lastDst, _mm256_loadu_si256((const __m256i *)lastSrc));
+
+    _mm256_zeroupper();
+}
+
+internal void __memoryClearAvx2(void* mem, i64 numBytes)
+{
+    u8* d = (u8 *)mem;
+    u8* last = d + numBytes - 32;
+    i64 skip = 32 - (i64)((uintptr_t)d & 31);
+    __m256i z = _mm256_setzero_si256();
+
+    if (numBytes < K_MEMORY_SIMD_MIN)
+    {
+        memset(mem, 0, (size_t)numBytes);
+        return;
+    }
+
+    _mm256_storeu_si256((__m256i *)d, z);
+    d += skip;
+    numBytes -= skip;
+
+    if (numBytes >= gMemoryStreamingThreshold)
+    {
+        for (; numBytes >= 128; numBytes -= 128, d += 128)
+        {
+            _mm256_stream_si256((__m256i *)d + 0, z);
+            _mm256_stream_si256((__m256i *)d + 1, z);
+            _mm256_stream_si256((__m256i *)d + 2, z);
+            _mm256_stream_si256((__m256i *)d + 3, z);
+        }
+        _mm_sfence();
+    }
+    else
+    {
+        for (; numBytes >= 128; numBytes -= 128, d += 128)
+        {
+            _mm256_store_si256((__m256i *)d + 0, z);
+            _mm256_store_si256((__m256i *)d + 1, z);
+            _mm256_store_si256((__m256i *)d + 2, z);
+            _mm256_store_si256((__m256i *)d + 3, z);
+        }
+    }
+
+    for (; numBytes >= 32; numBytes -= 32, d += 32)
+    {
+        _mm256_store_si256((__m256i *)d, z);
+    }
+    _mm256_storeu_si256((__m256i *)last, z);
+
+    _mm256_zeroupper();
+}
+
+internal void __memoryCopyAvx512(const void* src, void* dst, i64 numBytes)
+{
+    const u8* s = (const u8 *)src;
+    u8* d = (u8 *)dst;
+    const u8* lastSrc = s + numBytes - 64;
+    u8* lastDst = d + numBytes - 64;
+    i64 skip = 64 - (i64)((uintptr_t)d & 63);
+
+    if (numBytes < K_MEMORY_SIMD_MIN)
+    {
+        memcpy(dst, src, (size_t)numBytes);
+        return;
+    }
+
+    _mm512_storeu_si512(d, _mm512_loadu_si512(s));
+    s += skip;
+    d += skip;
+    numBytes -= skip;
+
+    if (numBytes >= gMemoryStreamingThreshold)
+    {
+        for (; numBytes >= 256; numBytes -= 256, s += 256, d += 256)
+        {
+            __m512i a = _mm512_loadu_si512(s + 0);
+            __m512i b = _mm512_loadu_si512(s + 64);
+            __m512i c = _mm512_loadu_si512(s + 128);
+            __m512i e = _mm512_loadu_si512(s + 192);
+            _mm512_stream_si512((__m512i *)(d + 0), a);
+            _mm512_stream_si512((__m512i *)(d + 64), b);
+            _mm512_stream_si512((__m512i *)(d + 128), c);
+            _mm512_stream_si512((__m512i *)(d + 192), e);
+        }
+        _mm_sfence();
+    }
+    else
+    {
+        for (; numBytes >= 256; numBytes -= 256, s += 256, d += 256)
+        {
+            __m512i a = _mm512_loadu_si512(s + 0);
+            __m512i b = _mm512_loadu_si512(s + 64);
+            __m512i c = _mm512_loadu_si512(s + 128);
+            __m512i e = _mm512_loadu_si512(s + 192);
+            _mm512_store_si512(d + 0, a);
+            _mm512_store_si512(d + 64, b);
+            _mm512_store_si512(d + 128, c);
+            _mm512_store_si512(d + 192, e);
+        }
+    }
+
+    for (; numBytes >= 64; numBytes -= 64, s += 64, d += 64)
+    {
+        _mm512_store_si512(d, _mm512_loadu_si512(s));
+    }
+    _mm512_storeu_si512(lastDst, _mm512_loadu_si512(lastSrc));
+
+    _mm256_zeroupper();
+}
+
+internal void __memoryClearAvx512(void* mem, i64 numBytes)
+{
+    u8* d = (u8 *)mem;
+    u8* last = d + numBytes - 64;
+    i64 skip = 64 - (i64)((uintptr_t)d & 63);
+    __m512i z = _mm512_setzero_si512();
+
+    if (numBytes < K_MEMORY_SIMD_MIN)
+    {
+        memset(mem, 0, (size_t)numBytes);
+        return;
+    }
+
+    _mm512_storeu_si512(d, z);
+    d += skip;
+    numBytes -= skip;
+
+    if (numBytes >= gMemoryStreamingThreshold)
+    {
+        for (; numBytes >= 256; numBytes -= 256, d += 256)
+        {
+            _mm512_stream_si512((__m512i *)(d + 0), z);
+            _mm512_stream_si512((__m512i *)(d + 64), z);
+            _mm512_stream_si512((__m512i *)(d + 128), z);
+            _mm512_stream_si512((__m512i *)(d + 192), z);
+        }
+        _mm_sfence();
+    }
+    else
+    {
+        for (; numBytes >= 256; numBytes -= 256, d += 256)
+        {
+            _mm512_store_si512(d + 0, z);
+            _mm512_store_si512(d + 64, z);
+            _mm512_store_si512(d + 128, z);
+            _mm512_store_si512(d + 192, z);
+        }
+    }
+
+    for (; numBytes >= 64; numBytes -= 64, d += 64)
+    {
+        _mm512_store_si512(d, z);
+    }
+    _mm512_storeu_si512(last, z);
+
+    _mm256_zeroupper();
+}
+
+#endif // CPU_X86 || CPU_X64
+
+internal void __memoryCopyFirst(const void* src, void* dst, i64 numBytes);
+internal void __memoryClearFirst(void* mem, i64 numBytes);
+
+MemoryCopyFunc gMemoryCopy = &__memoryCopyFirst;
+MemoryClearFunc gMemoryClear = &__memoryClearFirst;
+
+// Pick the best kernels for this CPU.  Several threads can race to do this but they will all pick the same ones.
+internal void __memorySelectKernels()
+{
+    MemoryCopyFunc copy = &__memoryCopyLibc;
+    MemoryClearFunc clear = &__memoryClearLibc;
+
+#if CPU_X86 || CPU_X64
+    int features = __memoryCpuFeatures();
+
+    if (features & K_MEMORY_CPU_AVX512)
+    {
+        copy = &__memoryCopyAvx512;
+        clear = &__memoryClearAvx512;
+    }
+    else if (features & K_MEMORY_CPU_AVX2)
+    {
+        copy = &__memoryCopyAvx2;
+        clear = &__memoryClearAvx2;
+    }
+#endif
+
+    gMemoryCopy = copy;
+    gMemoryClear = clear;
+}
+
+internal void __memoryCopyFirst(const void* src, void* dst, i64 numBytes)
+{
+    __memorySelectKernels();
+    gMemoryCopy(src, dst, numBytes);
+}
+
+internal void __memoryClearFirst(void* mem, i64 numBytes)
+{
+    __memorySelectKernels();
+    gMemoryClear(mem, numBytes);
+}
+
+void memorySetStreamingThreshold(i64 numBytes)
+{
+    gMemoryStreamingThreshold = numBytes;
+}
+
+void memoryCopy(const void* src, void* dst, i64 numBytes)
+{
+    gMemoryCopy(src, dst, numBytes);
+}
+
+void memoryMove(const void* src, void* dst, i64 numBytes)
+{
+    const u8* s = (const u8 *)src;
+    u8* d = (u8 *)dst;
+
+    if (d + numBytes <= s || s + numBytes <= d)
+    {
+        // No overlap so a copy will do
+        gMemoryCopy(src, dst, numBytes);
+    }
+#if CPU_X86 || CPU_X64
+    else if (d < s && s - d >= 64 && numBytes >= K_MEMORY_SIMD_MIN &&
+             (gMemoryCopy == &__memoryCopyAvx2 || gMemoryCopy == &__memoryCopyAvx512))
+    {
+        // The SIMD kernels work forwards and load each block before storing it, so they can move memory down as long
+        // as the destination is at least a vector behind the source.  This is the common case of closing a gap.
+        gMemoryCopy(src, dst, numBytes);
+    }
+#endif
+    else
+    {
+        memmove(dst, src, (size_t)numBytes);
+    }
+}
+
+int memoryCompare(const void* mem1, const void* mem2, i64 numBytes)
+{
+    return memcmp(mem1, mem2, (size_t)numBytes);
+}
+
+void memoryClear(void* mem, i64 numBytes)
+{
+    gMemoryClear(mem, numBytes);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Arena statistics
+//----------------------------------------------------------------------------------------------------------------------
+
+#if K_ARENA_STATS
+
+Arena* gArenaRegistry = 0;
+#if OS_WIN32
+SRWLOCK gArenaRegistryLock;
+#else
+#   error Implement the arena registry lock for your OS.
+#endif
+
+// Reset the statistics of a newly initialised arena and add it to the registry.
+internal void __arenaStatsInit(Arena* arena)
+{
+    arena->name = 0;
+    arena->highWater = arena->cursor;
+    arena->alignPadding = 0;
+    arena->numGrows = 0;
+    arena->pushDepth = 0;
+    arena->prevArena = 0;
+
+    // A loaded arena can already have restore points
+    for (i64 r = arena->restore; r != -1; r = ((i64 *)(arena->start + r))[1]) ++arena->pushDepth;
+    arena->maxPushDepth = arena->pushDepth;
+
+    AcquireSRWLockExclusive(&gArenaRegistryLock);
+    arena->nextArena = gArenaRegistry;
+    if (gArenaRegistry) gArenaRegistry->prevArena = arena;
+    gArenaRegistry = arena;
+    ReleaseSRWLockExclusive(&gArenaRegistryLock);
+}
+
+// Remove an arena from the registry.
+internal void __arenaStatsDone(Arena* arena)
+{
+    AcquireSRWLockExclusive(&gArenaRegistryLock);
+    if (arena->prevArena)
+    {
+        arena->prevArena->nextArena = arena->nextArena;
+    }
+    else if (gArenaRegistry == arena)
+    {
+        gArenaRegistry = arena->nextArena;
+    }
+    else
+    {
+        // Not registered
+        ReleaseSRWLockExclusive(&gArenaRegistryLock);
+        return;
+    }
+    if (arena->nextArena) arena->nextArena->prevArena = arena->prevArena;
+    arena->prevArena = 0;
+    arena->nextArena = 0;
+    ReleaseSRWLockExclusive(&gArenaRegistryLock);
+}
+
+void arenaSetName(Arena* arena, const char* name)
+{
+    arena->name = name;
+}
+
+internal const char* __arenaKindName(i64 kind)
+{
+    static const char* names[] = { "heap", "virtual", "huge", "mapped" };
+    return kind >= 0 && kind < (i64)(sizeof(names) / sizeof(names[0])) ? names[kind] : "unknown";
+}
+
+void arenaDumpStats(FILE* f)
+{
+    AcquireSRWLockShared(&gArenaRegistryLock);
+    for (Arena* arena = gArenaRegistry; arena; arena = arena->nextArena)
+    {
+        fprintf(f, "%s (%s arena at %p): %lld used, %lld high water, %lld capacity, %lld reserved, "
+            "%lld alignment padding, %lld grows, push depth %lld (max %lld)\n",
+            arena->name ? arena->name : "<unnamed>", __arenaKindName(arena->kind), arena->start, arena->cursor,
+            arena->highWater, (i64)(arena->end - arena->start), arena->reserved, arena->alignPadding,
+            arena->numGrows, arena->pushDepth, arena->maxPushDepth);
+    }
+    ReleaseSRWLockShared(&gArenaRegistryLock);
+}
+
+void arenaDumpStatsJson(FILE* f)
+{
+    bool first = YES;
+
+    AcquireSRWLockShared(&gArenaRegistryLock);
+    fprintf(f, "[");
+    for (Arena* arena = gArenaRegistry; arena; arena = arena->nextArena)
+    {
+        fprintf(f, "%s\n  {\"name\": ", first ? "" : ",");
+        if (arena->name)
+        {
+            fputc('"', f);
+            for (const char* s = arena->name; *s; ++s)
+            {
+                if (*s == '\\' || *s == '"') fputc('\\', f);
+                fputc(*s, f);
+            }
+            fputc('"', f);
+        }
+        else
+        {
+            fprintf(f, "null");
+        }
+        fprintf(f, ", \"kind\": \"%s\", \"used\": %lld, \"highWater\": %lld, \"capacity\": %lld, "
+            "\"reserved\": %lld, \"alignPadding\": %lld, \"numGrows\": %lld, \"pushDepth\": %lld, "
+            "\"maxPushDepth\": %lld}",
+            __arenaKindName(arena->kind), arena->cursor, arena->highWater, (i64)(arena->end - arena->start),
+            arena->reserved, arena->alignPadding, arena->numGrows, arena->pushDepth, arena->maxPushDepth);
+        first = NO;
+    }
+    fprintf(f, "\n]\n");
+    ReleaseSRWLockShared(&gArenaRegistryLock);
+}
+
+#else
+
+internal void __arenaStatsInit(Arena* arena)
+{
+}
+
+internal void __arenaStatsDone(Arena* arena)
+{
+}
+
+void arenaSetName(Arena* arena, const char* name)
+{
+}
+
+void arenaDumpStats(FILE* f)
+{
+}
+
+void arenaDumpStatsJson(FILE* f)
+{
+}
+
+#endif // K_ARENA_STATS
+
+//----------------------------------------------------------------------------------------------------------------------
+// Arena control
+//----------------------------------------------------------------------------------------------------------------------
+
+void arenaInit(Arena* arena, i64 initialSize)
+{
+    u8* buffer = (u8 *)malloc(initialSize);
+    if (buffer)
+    {
+        arena->start = buffer;
+        arena->end = arena->start + initialSize;
+        arena->cursor = 0;
+        arena->restore = -1;
+        arena->reserved = 0;
+        arena->kind = K_ARENA_HEAP;
+        arena->numaNode = K_NUMA_NONE;
+        __arenaStatsInit(arena);
+    }
+}
+
+// Reserve the address range of a virtual arena, preferring a NUMA node for the whole range unless it is K_NUMA_NONE.
+internal void __arenaInitVirtual(Arena* arena, i64 reserveSize, i64 node)
+{
+    u8* buffer = 0;
+
+    reserveSize = __memoryRoundUp(reserveSize, K_ARENA_COMMIT_SIZE);
+    buffer = (u8 *)__memoryVirtualAlloc(0, reserveSize, MEM_RESERVE, PAGE_NOACCESS, node);
+
+    if (buffer)
+    {
+        arena->start = buffer;
+        arena->end = buffer;
+        arena->cursor = 0;
+        arena->restore = -1;
+        arena->reserved = reserveSize;
+        arena->kind = K_ARENA_VIRTUAL;
+        arena->numaNode = node;
+        __arenaStatsInit(arena);
+    }
+}
+
+void arenaInitVirtual(Arena* arena, i64 reserveSize)
+{
+    __arenaInitVirtual(arena, reserveSize, K_NUMA_NONE);
+}
+
+void arenaInitHuge(Arena* arena, i64 size)
+{
+    u8* buffer = (u8 *)__memoryLargePageAlloc(&size);
+
+    if (buffer)
+    {
+        arena->start = buffer;
+        arena->end = buffer + size;
+        arena->cursor = 0;
+        arena->restore = -1;
+        arena->reserved = size;
+        arena->kind = K_ARENA_HUGE;
+        arena->numaNode = K_NUMA_NONE;
+        __arenaStatsInit(arena);
+    }
+    else
+    {
+        arenaInitVirtual(arena, size);
+    }
+}
+
+void arenaInitNuma(Arena* arena, i64 reserveSize, i64 node)
+{
+    arena->start = 0;
+    __arenaInitVirtual(arena, reserveSize, __memoryNumaResolve(node));
+}
+
+void arenaDone(Arena* arena)
+{
+    __arenaStatsDone(arena);
+    if (arena->kind == K_ARENA_VIRTUAL)
+    {
+#if OS_WIN32
+        VirtualFree(arena->start, 0, MEM_RELEASE);
+#endif
+    }
+    else if (arena->kind == K_ARENA_HUGE)
+    {
+        __memoryHugeFree(arena->start);
+    }
+    else if (arena->kind == K_ARENA_MAPPED)
+    {
+        // The file header occupies the page before the arena's contents
+#if OS_WIN32
+        UnmapViewOfFile(arena->start - K_PAGE_SIZE);
+#endif
+    }
+    else
+    {
+        free(arena->start);
+    }
+    arena->start = 0;
+    arena->end = 0;
+    arena->cursor = 0;
+    arena->restore = -1;
+    arena->reserved = 0;
+    arena->kind = K_ARENA_HEAP;
+    arena->numaNode = K_NUMA_NONE;
+}
+
+// Make sure that the first numBytes of a virtual arena are committed.
+internal bool __arenaCommit(Arena* arena, i64 numBytes)
+{
+    i64 committed = (i64)(arena->end - arena->start);
+    i64 newCommitted = K_MIN(__memoryRoundUp(numBytes, K_ARENA_COMMIT_SIZE), arena->reserved);
+
+    if (numBytes > arena->reserved) return NO;
+    if (newCommitted > committed)
+    {
+        if (!__memoryVirtualAlloc(arena->end, newCommitted - committed, MEM_COMMIT, PAGE_READWRITE, arena->numaNode))
+        {
+            return NO;
+        }
+        arena->end = arena->start + newCommitted;
+#if K_ARENA_STATS
+        ++arena->numGrows;
+#endif
+    }
+
+    return YES;
+}
+
+// Release the pages of a virtual arena that are beyond the cursor.  One commit block of slack is kept so that
+// pushing and popping around a block boundary does not thrash.
+internal void __arenaDecommit(Arena* arena)
+{
+    i64 committed = (i64)(arena->end - arena->start);
+    i64 keep = __memoryRoundUp(arena->cursor, K_ARENA_COMMIT_SIZE) + K_ARENA_COMMIT_SIZE;
+
+    if (keep < committed)
+    {
+#if OS_WIN32
+        VirtualFree(arena->start + keep, (SIZE_T)(committed - keep), MEM_DECOMMIT);
+#endif
+        arena->end = arena->start + keep;
+    }
+}
+
+void* arenaAlloc(Arena* arena, i64 size)
+{
+    void* p = 0;
+    K_ASSERT(arena->kind != K_ARENA_MAPPED, "Loaded arenas can not be allocated from");
+    if ((arena->start + arena->cursor + size) > arena->end)
+    {
+        // We don't have enough room
+        if (arena->kind == K_ARENA_VIRTUAL)
+        {
+            if (__arenaCommit(arena, arena->cursor + size))
+            {
+                p = arenaAlloc(arena, size);
+            }
+        }
+        else if (arena->kind == K_ARENA_HEAP)
+        {
+            i64 currentSize = (i64)(arena->end - arena->start);
+            i64 requiredSize = currentSize + size;
+            i64 newSize = currentSize + K_MAX(requiredSize, K_ARENA_INCREMENT);
+
+            u8* newArena = (u8 *)realloc(arena->start, newSize);
+
+            if (newArena)
+            {
+                arena->start = newArena;
+                arena->end = newArena + newSize;
+#if K_ARENA_STATS
+                ++arena->numGrows;
+#endif
+
+                // Try again!
+                p = arenaAlloc(arena, size);
+            }
+        }
+    }
+    else
+    {
+        p = arena->start + arena->cursor;
+        arena->cursor += size;
+#if K_ARENA_STATS
+        arena->highWater = K_MAX(arena->highWater, arena->cursor);
+#endif
+    }
+
+    return p;
+}
+
+void* arenaAlign(Arena* arena)
 {
     i64 mod = arena->cursor % K_ARENA_ALIGN;
-    void* p = arena->start + arena->cursor;
 
     if (mod)
     {
-        // We need to align
-        arenaAlloc(arena, K_ARENA_ALIGN - mod);
+        // We need to align
+#if K_ARENA_STATS
+        if (arenaAlloc(arena, K_ARENA_ALIGN - mod)) arena->alignPadding += K_ARENA_ALIGN - mod;
+#else
+        arenaAlloc(arena, K_ARENA_ALIGN - mod);
+#endif
+    }
+
+    return arena->start + arena->cursor;
+}
+
+void* arenaAlignedAlloc(Arena* arena, i64 numBytes)
+{
+    arenaAlign(arena);
+    return arenaAlloc(arena, numBytes);
+}
+
+// Allocate numBytes so that the address offset bytes into the allocation is aligned.
+internal void* __arenaAllocAligned(Arena* arena, i64 numBytes, i64 alignment, i64 offset)
+{
+    i64 padding;
+
+    K_ASSERT((alignment & (alignment - 1)) == 0, "Alignment must be a power of two");
+
+    // Make room for the padding and the allocation first, so that a heap arena does not move after we have aligned
+    if (!arenaAlloc(arena, numBytes + alignment)) return 0;
+    arena->cursor -= numBytes + alignment;
+
+    padding = (i64)((alignment - ((uintptr_t)(arena->start + arena->cursor + offset) & (alignment - 1))) &
+        (alignment - 1));
+    arena->cursor += padding;
+#if K_ARENA_STATS
+    arena->alignPadding += padding;
+#endif
+    return arenaAlloc(arena, numBytes);
+}
+
+void* arenaAlignTo(Arena* arena, i64 alignment)
+{
+    return __arenaAllocAligned(arena, 0, alignment, 0);
+}
+
+void* arenaAlignedAllocTo(Arena* arena, i64 numBytes, i64 alignment)
+{
+    return __arenaAllocAligned(arena, numBytes, alignment, 0);
+}
+
+bool arenaPush(Arena* arena)
+{
+    K_ASSERT(arena->kind != K_ARENA_MAPPED, "Loaded arenas can not be pushed");
+    arenaAlign(arena);
+    {
+        i64* p = arenaAlloc(arena, sizeof(i64) * 2);
+        if (!p) return NO;
+
+        p[0] = 0xaaaaaaaaaaaaaaaa;
+        p[1] = arena->restore;
+        arena->restore = (i64)((u8 *)p - arena->start);
+#if K_ARENA_STATS
+        ++arena->pushDepth;
+        arena->maxPushDepth = K_MAX(arena->maxPushDepth, arena->pushDepth);
+#endif
+    }
+
+    return YES;
+}
+
+void arenaPop(Arena* arena)
+{
+    i64* p = 0;
+    K_ASSERT(arena->kind != K_ARENA_MAPPED, "Loaded arenas can not be popped");
+    K_ASSERT(arena->restore != -1, "Make sure we have some restore points left");
+    arena->cursor = arena->restore;
+    p = (i64 *)(arena->start + arena->cursor);
+    p[0] = 0xbbbbbbbbbbbbbbbb;
+    arena->restore = p[1];
+#if K_ARENA_STATS
+    --arena->pushDepth;
+#endif
+    if (arena->kind == K_ARENA_VIRTUAL) __arenaDecommit(arena);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Block arenas
+//----------------------------------------------------------------------------------------------------------------------
+
+typedef struct
+{
+    u64             magic;
+    void*           prev;
+    ArenaBlock*     block;
+    i64             cursor;
+}
+BlockArenaRestore;
+
+#define K_BLOCK_DATA(block) ((u8 *)((block) + 1))
+
+void blockArenaInit(BlockArena* arena, i64 blockSize)
+{
+    arena->block = 0;
+    arena->cursor = 0;
+    arena->blockSize = blockSize ? blockSize : K_BLOCK_ARENA_SIZE;
+    arena->freeBlocks = 0;
+    arena->restore = 0;
+}
+
+internal void __blockArenaFreeChain(ArenaBlock* block)
+{
+    while (block)
+    {
+        ArenaBlock* prev = block->prev;
+        K_FREE(block, sizeof(ArenaBlock) + block->size);
+        block = prev;
+    }
+}
+
+void blockArenaDone(BlockArena* arena)
+{
+    __blockArenaFreeChain(arena->block);
+    __blockArenaFreeChain(arena->freeBlocks);
+    blockArenaInit(arena, arena->blockSize);
+}
+
+// Release the current block, either to the free list or back to the heap if it is an oversized block.
+internal void __blockArenaRelease(BlockArena* arena)
+{
+    ArenaBlock* block = arena->block;
+    arena->block = block->prev;
+
+    if (block->size == arena->blockSize)
+    {
+        block->prev = arena->freeBlocks;
+        arena->freeBlocks = block;
+    }
+    else
+    {
+        K_FREE(block, sizeof(ArenaBlock) + block->size);
+    }
+
+    arena->cursor = arena->block ? arena->block->size : 0;
+}
+
+// Start a new block that has room for at least numBytes.
+internal bool __blockArenaNewBlock(BlockArena* arena, i64 numBytes)
+{
+    ArenaBlock* block = 0;
+
+    if (numBytes <= arena->blockSize && arena->freeBlocks)
+    {
+        block = arena->freeBlocks;
+        arena->freeBlocks = block->prev;
+    }
+    else
+    {
+        i64 size = K_MAX(numBytes, arena->blockSize);
+        block = (ArenaBlock *)K_ALLOC(sizeof(ArenaBlock) + size);
+        if (!block) return NO;
+        block->size = size;
+    }
+
+    block->prev = arena->block;
+    arena->block = block;
+    arena->cursor = 0;
+
+    return YES;
+}
+
+void* blockArenaAlloc(BlockArena* arena, i64 size)
+{
+    void* p = 0;
+
+    if (!arena->block || arena->cursor + size > arena->block->size)
+    {
+        if (!__blockArenaNewBlock(arena, size)) return 0;
+    }
+
+    p = K_BLOCK_DATA(arena->block) + arena->cursor;
+    arena->cursor += size;
+
+    return p;
+}
+
+void* blockArenaAlign(BlockArena* arena)
+{
+    i64 mod = arena->cursor % K_ARENA_ALIGN;
+
+    if (mod && arena->block && arena->cursor + (K_ARENA_ALIGN - mod) <= arena->block->size)
+    {
+        // We need to align.  If there is not enough room left, the next allocation starts a new, aligned, block.
+        arena->cursor += K_ARENA_ALIGN - mod;
+    }
+
+    return arena->block ? K_BLOCK_DATA(arena->block) + arena->cursor : 0;
+}
+
+void* blockArenaAlignedAlloc(BlockArena* arena, i64 numBytes)
+{
+    blockArenaAlign(arena);
+    return blockArenaAlloc(arena, numBytes);
+}
+
+bool blockArenaPush(BlockArena* arena)
+{
+    BlockArenaRestore* r = K_BLOCK_ARENA_ALLOC(arena, BlockArenaRestore, 1);
+    if (!r) return NO;
+
+    r->magic = 0xaaaaaaaaaaaaaaaa;
+    r->prev = arena->restore;
+    r->block = arena->block;
+    r->cursor = (i64)((u8 *)r - K_BLOCK_DATA(arena->block));
+    arena->restore = r;
+    return YES;
+}
+
+void blockArenaPop(BlockArena* arena)
+{
+    BlockArenaRestore* r = (BlockArenaRestore *)arena->restore;
+    K_ASSERT(r != 0, "Make sure we have some restore points left");
+
+    while (arena->block != r->block)
+    {
+        __blockArenaRelease(arena);
+    }
+
+    r->magic = 0xbbbbbbbbbbbbbbbb;
+    arena->cursor = r->cursor;
+    arena->restore = r->prev;
+}
+
+void blockArenaReset(BlockArena* arena)
+{
+    while (arena->block)
+    {
+        __blockArenaRelease(arena);
+    }
+
+    arena->cursor = 0;
+    arena->restore = 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Concurrent arenas
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_CONCURRENT_ARENA_ROUND(numBytes) (((numBytes) + K_ARENA_ALIGN - 1) & ~(i64)(K_ARENA_ALIGN - 1))
+
+void concurrentArenaInit(ConcurrentArena* arena, i64 reserveSize, i64 chunkSize)
+{
+    arena->cursor = 0;
+    arena->committed = 0;
+    arena->reserved = __memoryRoundUp(reserveSize, K_CONCURRENT_ARENA_COMMIT_SIZE);
+    arena->chunkSize = K_CONCURRENT_ARENA_ROUND(chunkSize ? chunkSize : K_CONCURRENT_ARENA_CHUNK_SIZE);
+#if OS_WIN32
+    arena->start = (u8 *)VirtualAlloc(0, (SIZE_T)arena->reserved, MEM_RESERVE, PAGE_NOACCESS);
+    InitializeSRWLock(&arena->commitLock);
+#else
+#   error Implement concurrentArenaInit for your OS.
+#endif
+
+    if (!arena->start) arena->reserved = 0;
+}
+
+void concurrentArenaDone(ConcurrentArena* arena)
+{
+#if OS_WIN32
+    if (arena->start) VirtualFree(arena->start, 0, MEM_RELEASE);
+#endif
+    arena->start = 0;
+    arena->cursor = 0;
+    arena->committed = 0;
+    arena->reserved = 0;
+}
+
+// Make sure that the first numBytes of a concurrent arena are committed.
+internal bool __concurrentArenaCommit(ConcurrentArena* arena, i64 numBytes)
+{
+    bool committed = YES;
+
+#if OS_WIN32
+    AcquireSRWLockExclusive(&arena->commitLock);
+#endif
+
+    // Another thread may have committed the pages while this one waited
+    if (arena->committed < numBytes)
+    {
+        i64 newCommitted = K_MIN(__memoryRoundUp(numBytes, K_CONCURRENT_ARENA_COMMIT_SIZE), arena->reserved);
+
+        // Only publish the new size once the pages exist
+        if (__memoryVirtualAlloc(arena->start + arena->committed, newCommitted - arena->committed, MEM_COMMIT,
+            PAGE_READWRITE, K_NUMA_NONE))
+        {
+            arena->committed = newCommitted;
+        }
+        else
+        {
+            committed = NO;
+        }
+    }
+
+#if OS_WIN32
+    ReleaseSRWLockExclusive(&arena->commitLock);
+#endif
+
+    return committed;
+}
+
+void* concurrentArenaAlloc(ConcurrentArena* arena, i64 numBytes)
+{
+    i64 size = K_CONCURRENT_ARENA_ROUND(numBytes);
+    i64 offset = InterlockedExchangeAdd64(&arena->cursor, size);
+
+    if (offset + size > arena->reserved) return 0;
+    if (arena->committed < offset + size && !__concurrentArenaCommit(arena, offset + size)) return 0;
+
+    return arena->start + offset;
+}
+
+i64 concurrentArenaUsed(const ConcurrentArena* arena)
+{
+    return K_MIN(arena->cursor, arena->reserved);
+}
+
+void concurrentArenaReset(ConcurrentArena* arena)
+{
+    arena->cursor = 0;
+}
+
+void concurrentArenaCacheInit(ConcurrentArenaCache* cache, ConcurrentArena* arena)
+{
+    cache->arena = arena;
+    cache->cursor = 0;
+    cache->end = 0;
+}
+
+void* concurrentArenaCacheAlloc(ConcurrentArenaCache* cache, i64 numBytes)
+{
+    i64 size = K_CONCURRENT_ARENA_ROUND(numBytes);
+    u8* p = cache->cursor;
+
+    // A new cache has no chunk, so even an empty allocation needs one to point into
+    if (!p || size > (i64)(cache->end - cache->cursor))
+    {
+        ConcurrentArena* arena = cache->arena;
+
+        // Big allocations would waste most of a chunk, so they do not replace the current one
+        if (size > arena->chunkSize / 2) return concurrentArenaAlloc(arena, size);
+
+        p = (u8 *)concurrentArenaAlloc(arena, arena->chunkSize);
+        if (!p) return 0;
+        cache->end = p + arena->chunkSize;
     }
 
+    cache->cursor = p + size;
     return p;
 }
 
-void* arenaAlignedAlloc(Arena* arena, i64 numBytes)
-{
-    arenaAlign(arena);
-    return arenaAlloc(arena, numBytes);
-}
+#undef K_CONCURRENT_ARENA_ROUND
+
+//----------------------------------------------------------------------------------------------------------------------
+// Scratch arenas
+//----------------------------------------------------------------------------------------------------------------------
 
-void arenaPush(Arena* arena)
+K_THREAD_LOCAL Arena gScratchArenas[K_SCRATCH_COUNT];
+
+Scratch scratchBeginConflicts(Arena** conflicts, int numConflicts)
 {
-    arenaAlign(arena);
+    Scratch scratch = { 0 };
+
+    K_ASSERT(numConflicts < K_SCRATCH_COUNT, "Not enough scratch arenas to avoid all conflicts");
+
+    for (int i = 0; i < K_SCRATCH_COUNT; ++i)
     {
-        i64* p = arenaAlloc(arena, sizeof(i64) * 2);
-        p[0] = 0xaaaaaaaaaaaaaaaa;
-        p[1] = arena->restore;
-        arena->restore = (i64)((u8 *)p - arena->start);
+        Arena* arena = &gScratchArenas[i];
+        bool conflicted = NO;
+
+        for (int j = 0; j < numConflicts; ++j)
+        {
+            if (conflicts[j] == arena)
+            {
+                conflicted = YES;
+                break;
+            }
+        }
+
+        if (!conflicted)
+        {
+            if (!arena->start) arenaInitVirtual(arena, K_SCRATCH_RESERVE);
+            K_ASSERT(arena->start, "Could not reserve the address range of a scratch arena");
+            if (arena->start && arenaPush(arena)) scratch.arena = arena;
+            break;
+        }
     }
+
+    return scratch;
 }
 
-void arenaPop(Arena* arena)
+Scratch scratchBegin(Arena* conflict)
 {
-    i64* p = 0;
-    K_ASSERT(arena->restore != -1, "Make sure we have some restore points left");
-    arena->cursor = arena->restore;
-    p = (i64 *)(arena->start + arena->cursor);
-    p[0] = 0xbbbbbbbbbbbbbbbb;
-    arena->restore = p[1];
+    return scratchBeginConflicts(&conflict, conflict ? 1 : 0);
+}
+
+void scratchEnd(Scratch scratch)
+{
+    if (scratch.arena) arenaPop(scratch.arena);
+}
+
+void scratchDone()
+{
+    for (int i = 0; i < K_SCRATCH_COUNT; ++i)
+    {
+        if (gScratchArenas[i].start) arenaDone(&gScratchArenas[i]);
+    }
 }
 
 //----------------------------------------------------------------------------------------------------------------------
 // Arrays
 //----------------------------------------------------------------------------------------------------------------------
 
-internal void* __arrayInternalGrow(void* a, i64 increment, i64 elemSize)
+internal void* __arrayInternalGrow(void* a, i64 increment, i64 elemSize, const char* file, int line)
 {
     i64 doubleCurrent = a ? 2 * __arrayCapacity(a) : 0;
     i64 minNeeded = arrayCount(a) + increment;
     i64 capacity = doubleCurrent > minNeeded ? doubleCurrent : minNeeded;
-    i64 oldBytes = a ? elemSize * arrayCount(a) + sizeof(i64) * 2 : 0;
-    i64 bytes = elemSize * capacity + sizeof(i64) * 2;
-    i64* p = (i64 *)K_REALLOC(a ? __arrayRaw(a) : 0, oldBytes, bytes);
-    if (p)
+
+    return a
+        ? __arrayInternalResize(a, capacity, elemSize, __arrayHeader(a)->storage, __arrayHeader(a)->arena, file, line)
+        : __arrayInternalResize(a, capacity, elemSize, K_ARRAY_HEAP, 0, file, line);
+}
+
+// Return the alignment of the elements for the given storage, or 0 if the storage's natural alignment is used.
+internal i64 __arrayAlignment(i64 storage)
+{
+    return (storage & 0xff00) ? (i64)1 << ((storage >> 8) & 0xff) : 0;
+}
+
+// Return the number of bytes between the start of huge or virtual storage and the array header.  The header is
+// pushed forward so that the elements after it are aligned.
+internal i64 __arrayBaseOffset(i64 storage)
+{
+    return K_MAX(__arrayAlignment(storage), (i64)sizeof(ArrayHeader)) - (i64)sizeof(ArrayHeader);
+}
+
+// Returns YES if an arena array ends at its arena's cursor, so it can be grown or shrunk in place.
+internal bool __arrayIsLastOnArena(void* a, i64 elemSize)
+{
+    ArrayHeader* hdr = __arrayHeader(a);
+    return K_BOOL((u8 *)a + hdr->capacity * elemSize == hdr->arena->start + hdr->arena->cursor);
+}
+
+internal void __arrayInternalRelease(void* a, i64 elemSize, const char* file, int line)
+{
+    ArrayHeader* hdr = __arrayHeader(a);
+    i64 alignment = __arrayAlignment(hdr->storage);
+
+    switch (K_ARRAY_KIND(hdr->storage))
+    {
+    case K_ARRAY_HEAP:
+        if (alignment > (i64)K_MEMORY_ALIGN)
+        {
+            __memoryFreeAligned(hdr, elemSize * hdr->capacity + sizeof(ArrayHeader), alignment, file, line);
+        }
+        else
+        {
+            memoryFree(hdr, elemSize * hdr->capacity + sizeof(ArrayHeader), file, line);
+        }
+        break;
+
+    case K_ARRAY_HUGE:
+    case K_ARRAY_VIRTUAL:
+        __memoryHugeFree((u8 *)hdr - __arrayBaseOffset(hdr->storage));
+        break;
+
+    case K_ARRAY_ARENA:
+        if (__arrayIsLastOnArena(a, elemSize))
+        {
+            hdr->arena->cursor = (i64)((u8 *)hdr - hdr->arena->start);
+        }
+        break;
+    }
+}
+
+// Make sure the first numBytes bytes of a virtual array's reserved range are committed.  Committing pages that are
+// already committed is harmless so there is no need to track what was committed before.
+internal bool __arrayVirtualCommit(void* base, i64 numBytes, i64 node)
+{
+    return __memoryVirtualAlloc(base, numBytes, MEM_COMMIT, PAGE_READWRITE, node) != 0;
+}
+
+// Reserve an address range for a virtual array with room to grow, and commit the first numBytes.  Returns 0 if
+// there is not enough address space.
+internal u8* __arrayVirtualAlloc(i64 numBytes, i64* reserved, i64 node)
+{
+    i64 reserve = K_MAX(K_ARRAY_VIRTUAL_RESERVE, numBytes * 4);
+    u8* base = 0;
+
+#if !CPU_X64
+    // Leave most of a 32-bit address space for everything else
+    reserve = K_MAX(K_MIN(reserve, (i64)GB(1)), numBytes);
+#endif
+    reserve = __memoryRoundUp(reserve, K_ARENA_COMMIT_SIZE);
+    base = (u8 *)__memoryVirtualAlloc(0, reserve, MEM_RESERVE, PAGE_NOACCESS, node);
+
+    if (base)
+    {
+        if (__arrayVirtualCommit(base, numBytes, node))
+        {
+            *reserved = reserve;
+        }
+        else
+        {
+            __memoryHugeFree(base);
+            base = 0;
+        }
+    }
+
+    return base;
+}
+
+// Allocate heap storage for an array of the given number of bytes, including the header.
+internal ArrayHeader* __arrayHeapAlloc(i64 bytes, i64 alignment, const char* file, int line)
+{
+    ArrayHeader* hdr = alignment > (i64)K_MEMORY_ALIGN
+        ? (ArrayHeader *)__memoryAllocAligned(bytes, alignment, sizeof(ArrayHeader), file, line)
+        : (ArrayHeader *)memoryAlloc(bytes, file, line);
+
+    if (hdr) hdr->size = 0;
+    return hdr;
+}
+
+// Change the capacity of an array, and optionally the kind of storage it lives in.  The capacity can not be less
+// than the number of elements.  If no alignment is given in the storage, the array keeps its current one.
+internal void* __arrayInternalResize(void* a, i64 capacity, i64 elemSize, i64 storage, Arena* arena,
+    const char* file, int line)
+{
+    ArrayHeader* hdr = 0;
+    i64 oldStorage = a ? __arrayHeader(a)->storage : -1;
+    i64 count = arrayCount(a);
+    i64 bytes = elemSize * capacity + sizeof(ArrayHeader);
+    i64 alignment;
+    i64 baseOffset;
+    bool onSameArena = K_BOOL(oldStorage == storage && K_ARRAY_KIND(storage) == K_ARRAY_ARENA &&
+        __arrayHeader(a)->arena == arena);
+
+    K_ASSERT(capacity >= count, "Resizing the array would lose elements");
+
+    if (a && !(storage >> 8))
+    {
+        storage |= oldStorage & ~(i64)0xff;
+        onSameArena = K_BOOL(oldStorage == storage && K_ARRAY_KIND(storage) == K_ARRAY_ARENA &&
+            __arrayHeader(a)->arena == arena);
+    }
+
+    if (K_ARRAY_KIND(storage) == K_ARRAY_HEAP && (bytes > K_ARRAY_VIRTUAL_THRESHOLD || (storage >> 16)))
+    {
+        // Large arrays grow by committing more pages rather than copying.  A NUMA array only lands on the heap when
+        // its address range could not be reserved, so it tries again.
+        storage = K_ARRAY_VIRTUAL | (storage & ~(i64)0xff);
+    }
+
+    alignment = __arrayAlignment(storage);
+    baseOffset = __arrayBaseOffset(storage);
+
+    if (K_ARRAY_KIND(storage) == K_ARRAY_VIRTUAL && oldStorage == storage &&
+        baseOffset + bytes <= __arrayHeader(a)->size)
+    {
+        // Grow in place
+        hdr = __arrayHeader(a);
+        bytes = K_MIN(__memoryRoundUp(baseOffset + bytes, K_ARENA_COMMIT_SIZE), hdr->size);
+        if (!__arrayVirtualCommit((u8 *)hdr - baseOffset, bytes, K_ARRAY_NUMA_NODE(storage))) return 0;
+        capacity = (bytes - baseOffset - (i64)sizeof(ArrayHeader)) / elemSize;
+    }
+    else if (onSameArena && __arrayIsLastOnArena(a, elemSize))
+    {
+        // Bump (or give back) the end of the arena.  A heap arena can move when it grows, so find the array again
+        // from its offset.
+        i64 offset = (i64)((u8 *)__arrayHeader(a) - arena->start);
+        i64 extra = (capacity - __arrayCapacity(a)) * elemSize;
+
+        if (extra > 0)
+        {
+            if (!arenaAlloc(arena, extra)) return 0;
+        }
+        else
+        {
+            arena->cursor += extra;
+        }
+        hdr = (ArrayHeader *)(arena->start + offset);
+    }
+    else if (storage == K_ARRAY_HEAP && (!a || oldStorage == K_ARRAY_HEAP))
+    {
+        i64 oldBytes = a ? elemSize * __arrayCapacity(a) + sizeof(ArrayHeader) : 0;
+        hdr = (ArrayHeader *)memoryRealloc(a ? __arrayHeader(a) : 0, oldBytes, bytes, file, line);
+        if (!hdr) return 0;
+        hdr->size = 0;
+    }
+    else
+    {
+        // Allocate new storage and move the elements over
+        switch (K_ARRAY_KIND(storage))
+        {
+        case K_ARRAY_HEAP:
+            hdr = __arrayHeapAlloc(bytes, alignment, file, line);
+            break;
+
+        case K_ARRAY_HUGE:
+            {
+                i64 size = baseOffset + bytes;
+                u8* base = (u8 *)__memoryHugeAlloc(&size);
+                if (base)
+                {
+                    hdr = (ArrayHeader *)(base + baseOffset);
+                    hdr->size = size;
+                    capacity = (size - baseOffset - (i64)sizeof(ArrayHeader)) / elemSize;
+                }
+            }
+            break;
+
+        case K_ARRAY_VIRTUAL:
+            {
+                i64 size = __memoryRoundUp(baseOffset + bytes, K_ARENA_COMMIT_SIZE);
+                i64 reserved = 0;
+                u8* base = __arrayVirtualAlloc(size, &reserved, K_ARRAY_NUMA_NODE(storage));
+                if (base)
+                {
+                    hdr = (ArrayHeader *)(base + baseOffset);
+                    hdr->size = reserved;
+                    capacity = (size - baseOffset - (i64)sizeof(ArrayHeader)) / elemSize;
+                }
+                else
+                {
+                    // Out of address space, so keep the array on the heap.  It tries virtual memory again the next
+                    // time it grows, on the same NUMA node.
+                    storage = K_ARRAY_HEAP | (storage & ~(i64)0xff);
+                    hdr = __arrayHeapAlloc(bytes, alignment, file, line);
+                }
+            }
+            break;
+
+        case K_ARRAY_ARENA:
+            {
+                // The arena can move if it grows, taking the old array with it
+                bool oldOnArena = K_BOOL(a && K_ARRAY_KIND(oldStorage) == K_ARRAY_ARENA &&
+                    __arrayHeader(a)->arena == arena);
+                i64 offset = oldOnArena ? (i64)((u8 *)a - arena->start) : 0;
+
+                hdr = alignment
+                    ? (ArrayHeader *)__arenaAllocAligned(arena, bytes, alignment, sizeof(ArrayHeader))
+                    : (ArrayHeader *)arenaAlignedAlloc(arena, bytes);
+                if (hdr)
+                {
+                    hdr->arena = arena;
+                    if (oldOnArena) a = arena->start + offset;
+                }
+            }
+            break;
+        }
+
+        if (!hdr) return 0;
+        if (a)
+        {
+            memoryCopy(a, hdr + 1, count * elemSize);
+            __arrayInternalRelease(a, elemSize, file, line);
+        }
+    }
+
+    hdr->storage = storage;
+    hdr->capacity = capacity;
+    hdr->count = count;
+
+    return hdr + 1;
+}
+
+// Make sure the array has room for capacity elements in the given storage.  Does nothing if it already does.
+internal void* __arrayInternalReserve(void* a, i64 capacity, i64 elemSize, i64 storage, Arena* arena,
+    const char* file, int line)
+{
+    if (a)
+    {
+        ArrayHeader* hdr = __arrayHeader(a);
+
+        if (!(storage >> 8)) storage |= hdr->storage & ~(i64)0xff;
+        if (hdr->storage == storage && hdr->capacity >= capacity &&
+            (K_ARRAY_KIND(storage) != K_ARRAY_ARENA || hdr->arena == arena))
+        {
+            return a;
+        }
+        capacity = K_MAX(capacity, hdr->capacity);
+    }
+
+    return __arrayInternalResize(a, capacity, elemSize, storage, arena, file, line);
+}
+
+internal void* __arrayInternalReserveAligned(void* a, i64 capacity, i64 elemSize, i64 alignment,
+    const char* file, int line)
+{
+    unsigned long shift = 0;
+
+    K_ASSERT((alignment & (alignment - 1)) == 0, "Alignment must be a power of two");
+    K_ASSERT(alignment <= 0xffffffff, "Alignment is too large");
+    _BitScanReverse(&shift, (u32)alignment);
+
+    return a
+        ? __arrayInternalReserve(a, capacity, elemSize,
+            (__arrayHeader(a)->storage & ~(i64)0xff00) | ((i64)shift << 8), __arrayHeader(a)->arena, file, line)
+        : __arrayInternalReserve(a, capacity, elemSize, K_ARRAY_HEAP | ((i64)shift << 8), 0, file, line);
+}
+
+internal void* __arrayInternalReserveNuma(void* a, i64 capacity, i64 elemSize, i64 node, const char* file, int line)
+{
+    i64 storage = K_ARRAY_VIRTUAL | ((__memoryNumaResolve(node) + 1) << 16);
+
+    // Keep any alignment
+    if (a) storage |= __arrayHeader(a)->storage & 0xff00;
+    return __arrayInternalReserve(a, capacity, elemSize, storage, 0, file, line);
+}
+
+internal i64 __arrayInternalRemoveIf(void* a, i64 elemSize, ArrayPredicate pred, void* context)
+{
+    u8* elems = (u8 *)a;
+    i64 count = __arrayCount(a);
+    i64 kept = 0;
+    i64 runStart = 0;
+
+    // Each time an entry is deleted, move the run of entries to keep before it down in one go.  Entries are only
+    // moved to indices that have already been tested.
+    for (i64 i = 0; i <= count; ++i)
+    {
+        if (i == count || pred(elems + i * elemSize, context))
+        {
+            if (runStart != kept && i > runStart)
+            {
+                memoryMove(elems + runStart * elemSize, elems + kept * elemSize, (i - runStart) * elemSize);
+            }
+            kept += i - runStart;
+            runStart = i + 1;
+        }
+    }
+
+    __arrayCount(a) = kept;
+    return count - kept;
+}
+
+internal void* __arrayInternalShrink(void* a, i64 elemSize, const char* file, int line)
+{
+    ArrayHeader* hdr = __arrayHeader(a);
+
+    if (hdr->capacity == hdr->count) return a;
+
+    switch (K_ARRAY_KIND(hdr->storage))
+    {
+    case K_ARRAY_HEAP:
+        a = __arrayInternalResize(a, hdr->count, elemSize, hdr->storage, 0, file, line);
+        break;
+
+    case K_ARRAY_VIRTUAL:
+        {
+            // Decommit the pages past the last element.  The address range stays reserved so the array can grow
+            // back in place.
+            i64 headerBytes = __arrayBaseOffset(hdr->storage) + (i64)sizeof(ArrayHeader);
+            u8* base = (u8 *)hdr - __arrayBaseOffset(hdr->storage);
+            i64 committed = __memoryRoundUp(headerBytes + hdr->capacity * elemSize, K_ARENA_COMMIT_SIZE);
+            i64 keep = __memoryRoundUp(headerBytes + hdr->count * elemSize, K_ARENA_COMMIT_SIZE);
+
+            if (keep < committed)
+            {
+#if OS_WIN32
+                VirtualFree(base + keep, (SIZE_T)(committed - keep), MEM_DECOMMIT);
+#endif
+                hdr->capacity = (keep - headerBytes) / elemSize;
+            }
+        }
+        break;
+
+    case K_ARRAY_ARENA:
+        if (__arrayIsLastOnArena(a, elemSize))
+        {
+            a = __arrayInternalResize(a, hdr->count, elemSize, hdr->storage, hdr->arena, file, line);
+        }
+        break;
+    }
+
+    // A failed resize leaves the array as it was
+    return a ? a : hdr + 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Slot maps
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_SLOTMAP_NONE 0xffffffff
+#define K_SLOTMAP_INDEX(h) ((u32)(h))
+#define K_SLOTMAP_GENERATION(h) ((u32)((h) >> 32))
+#define K_SLOTMAP_HANDLE(index, generation) (((Handle)(generation) << 32) | (Handle)(index))
+
+void slotMapInit(SlotMap* map, i64 elemSize)
+{
+    map->data = 0;
+    map->owners = 0;
+    map->slots = 0;
+    map->elemSize = elemSize;
+    map->freeSlot = K_SLOTMAP_NONE;
+}
+
+void slotMapDone(SlotMap* map)
+{
+    arrayRelease(map->data);
+    arrayRelease(map->owners);
+    arrayRelease(map->slots);
+    slotMapInit(map, map->elemSize);
+}
+
+void* slotMapAdd(SlotMap* map, Handle* handle)
+{
+    u32 slot = map->freeSlot;
+    SlotMapSlot* s;
+
+    if (slot == K_SLOTMAP_NONE)
     {
-        if (!a) p[1] = 0;
-        p[0] = capacity;
-        return p + 2;
+        slot = (u32)arrayCount(map->slots);
+        s = arrayExpand(map->slots, 1);
+        s->generation = 1;
     }
     else
     {
-        return 0;
+        s = &map->slots[slot];
+        map->freeSlot = s->index;
+    }
+
+    s->index = (u32)arrayCount(map->owners);
+    arrayAdd(map->owners, slot);
+    *handle = K_SLOTMAP_HANDLE(slot, s->generation);
+
+    return arrayExpand(map->data, map->elemSize);
+}
+
+bool slotMapRemove(SlotMap* map, Handle handle)
+{
+    u8* elem = (u8 *)slotMapGet(map, handle);
+    u32 slot = K_SLOTMAP_INDEX(handle);
+    SlotMapSlot* s;
+    u32 last;
+
+    if (!elem) return NO;
+    s = &map->slots[slot];
+
+    // Move the last element into the gap
+    last = (u32)arrayCount(map->owners) - 1;
+    if (s->index != last)
+    {
+        memoryCopy(map->data + (i64)last * map->elemSize, elem, map->elemSize);
+        map->owners[s->index] = map->owners[last];
+        map->slots[map->owners[last]].index = s->index;
+    }
+    --__arrayCount(map->owners);
+    __arrayCount(map->data) -= map->elemSize;
+
+    // Generation 0 is skipped so that a handle of 0 is never valid
+    if (++s->generation == 0) s->generation = 1;
+    s->index = map->freeSlot;
+    map->freeSlot = slot;
+
+    return YES;
+}
+
+void* slotMapGet(const SlotMap* map, Handle handle)
+{
+    u32 slot = K_SLOTMAP_INDEX(handle);
+    const SlotMapSlot* s;
+
+    if (slot >= (u32)arrayCount(map->slots)) return 0;
+    s = &map->slots[slot];
+    if (s->generation != K_SLOTMAP_GENERATION(handle)) return 0;
+
+    return map->data + (i64)s->index * map->elemSize;
+}
+
+i64 slotMapCount(const SlotMap* map)
+{
+    return arrayCount(map->owners);
+}
+
+void* slotMapAt(const SlotMap* map, i64 i)
+{
+    K_ASSERT(i >= 0 && i < slotMapCount(map), "Slot map index out of range");
+    return map->data + i * map->elemSize;
+}
+
+Handle slotMapHandleAt(const SlotMap* map, i64 i)
+{
+    u32 slot;
+
+    K_ASSERT(i >= 0 && i < slotMapCount(map), "Slot map index out of range");
+    slot = map->owners[i];
+    return K_SLOTMAP_HANDLE(slot, map->slots[slot].generation);
+}
+
+#undef K_SLOTMAP_NONE
+#undef K_SLOTMAP_INDEX
+#undef K_SLOTMAP_GENERATION
+#undef K_SLOTMAP_HANDLE
+
+//----------------------------------------------------------------------------------------------------------------------
+// Struct of arrays
+//----------------------------------------------------------------------------------------------------------------------
+
+#define __soaColumns(soa) ((void **)((soa) + 1))
+
+internal i64 __soaColumnBytes(i64 capacity, i64 elemSize)
+{
+    return (capacity * elemSize + K_CACHE_LINE_SIZE - 1) & ~(i64)(K_CACHE_LINE_SIZE - 1);
+}
+
+internal void __soaInit(SoaHeader* soa, const i64* sizes, i64 numColumns)
+{
+    void** columns = __soaColumns(soa);
+
+    soa->count = 0;
+    soa->capacity = 0;
+    soa->numColumns = numColumns;
+    soa->sizes = sizes;
+    soa->block = 0;
+    soa->blockSize = 0;
+    for (i64 i = 0; i < numColumns; ++i) columns[i] = 0;
+}
+
+internal void __soaDone(SoaHeader* soa)
+{
+    if (soa->block)
+    {
+        K_FREE_ALIGNED(soa->block, soa->blockSize, K_CACHE_LINE_SIZE);
+    }
+    __soaInit(soa, soa->sizes, soa->numColumns);
+}
+
+// Move all the columns to a new block.  Only the live records are copied.  Returns NO, leaving the container as it
+// was, if the block could not be allocated.
+internal bool __soaResize(SoaHeader* soa, i64 capacity)
+{
+    void** columns = __soaColumns(soa);
+    i64 blockSize = 0;
+    u8* block;
+    u8* p;
+
+    for (i64 i = 0; i < soa->numColumns; ++i) blockSize += __soaColumnBytes(capacity, soa->sizes[i]);
+    block = (u8 *)K_ALLOC_ALIGNED(blockSize, K_CACHE_LINE_SIZE);
+    if (!block) return NO;
+
+    p = block;
+    for (i64 i = 0; i < soa->numColumns; ++i)
+    {
+        if (soa->count) memoryCopy(columns[i], p, soa->count * soa->sizes[i]);
+        columns[i] = p;
+        p += __soaColumnBytes(capacity, soa->sizes[i]);
+    }
+
+    if (soa->block)
+    {
+        K_FREE_ALIGNED(soa->block, soa->blockSize, K_CACHE_LINE_SIZE);
+    }
+    soa->block = block;
+    soa->blockSize = blockSize;
+    soa->capacity = capacity;
+    return YES;
+}
+
+internal bool __soaReserve(SoaHeader* soa, i64 capacity)
+{
+    return capacity <= soa->capacity || __soaResize(soa, K_MAX(capacity, K_MAX(soa->capacity * 2, 16)));
+}
+
+internal i64 __soaExpand(SoaHeader* soa, i64 n)
+{
+    i64 index = soa->count;
+
+    if (!__soaReserve(soa, soa->count + n)) return -1;
+    soa->count += n;
+
+    return index;
+}
+
+internal void __soaDelete(SoaHeader* soa, i64 i)
+{
+    u8** columns = (u8 **)__soaColumns(soa);
+
+    K_ASSERT(i >= 0 && i < soa->count, "Struct of arrays index out of range");
+    for (i64 c = 0; c < soa->numColumns; ++c)
+    {
+        i64 size = soa->sizes[c];
+        memoryMove(columns[c] + (i + 1) * size, columns[c] + i * size, (soa->count - i - 1) * size);
+    }
+    --soa->count;
+}
+
+internal void __soaDeleteSwap(SoaHeader* soa, i64 i)
+{
+    u8** columns = (u8 **)__soaColumns(soa);
+    i64 last = soa->count - 1;
+
+    K_ASSERT(i >= 0 && i < soa->count, "Struct of arrays index out of range");
+    if (i != last)
+    {
+        for (i64 c = 0; c < soa->numColumns; ++c)
+        {
+            i64 size = soa->sizes[c];
+            memoryCopy(columns[c] + last * size, columns[c] + i * size, size);
+        }
     }
+    --soa->count;
 }
 
+#undef __soaColumns
+
 //----------------------------------------------------------------------------------------------------------------------
 //----------------------------------------------------------------------------------------------------------------------
 
@@ -103,11 +103,18 @@ typedef char    bool;
 #define K_MIN(a, b) ((a) < (b) ? (a) : (b))
 #define K_MAX(a, b) ((a) < (b) ? (b) : (a))
 #define K_ABS(a) ((a) < 0 ? -(a) : (a))
+#define K_SWAP(t, a, b) do { t __swapTemp = (a); (a) = (b); (b) = __swapTemp; } while (0)
 
 #define K_ASSERT(x, ...) assert(x)
 
 #define internal static
 
+#if COMPILER_MSVC
+#   define K_THREAD_LOCAL __declspec(thread)
+#else
+#   error Define K_THREAD_LOCAL for your compiler.
+#endif
+
 //----------------------------------------------------------------------------------------------------------------------
 // Timer functions
 
@@ -0,0 +1,290 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Pool allocator API
+// Fixed-size slots are carved out of large pages.  Free slots are kept on an intrusive free list so allocation and
+// deallocation are O(1).  Pages are only returned to the heap when the pool is destroyed.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+
+#ifndef K_POOL_PAGE_SIZE
+#   define K_POOL_PAGE_SIZE    KB(64)
+#endif
+
+// Maximum number of free slots a per-thread cache holds before returning half of them to its pool.
+#ifndef K_POOL_CACHE_SIZE
+#   define K_POOL_CACHE_SIZE   64
+#endif
+
+typedef struct PoolPage
+{
+    struct PoolPage*    next;
+    i64                 size;
+}
+PoolPage;
+
+typedef struct
+{
+    i64         slotSize;
+    i64         pageSize;
+    void*       freeList;
+    u8*         cursor;         // Next uncarved slot in the newest page.
+    u8*         end;
+    PoolPage*   pages;
+    i64         numaNode;       // Node the pages are committed on, or K_NUMA_NONE for pages from the heap.
+#if OS_WIN32
+    SRWLOCK     lock;
+#endif
+}
+Pool;
+
+// A per-thread cache of free slots.  Allocating and freeing through a cache does not touch the pool's lock until
+// the cache runs dry or overflows, at which point slots are moved in batches.
+typedef struct
+{
+    Pool*   pool;
+    void*   freeList;
+    i64     count;
+}
+PoolCache;
+
+// Initialise a pool of slots of a given size.  Slots are aligned to K_ARENA_ALIGN.
+void poolInit(Pool* pool, i64 slotSize);
+
+// Initialise a pool whose pages are committed on a NUMA node, or K_NUMA_CURRENT for the calling thread's node.  The
+// pages are whole multiples of K_ARENA_COMMIT_SIZE taken directly from the OS.
+void poolInitNuma(Pool* pool, i64 slotSize, i64 node);
+
+// Release all the pages used by the pool.  All caches must be destroyed first.
+void poolDone(Pool* pool);
+
+// Allocate a slot from the pool.  Thread-safe.
+void* poolAlloc(Pool* pool);
+
+// Return a slot to the pool.  Thread-safe.
+void poolFree(Pool* pool, void* slot);
+
+// Initialise a cache for the calling thread.
+void poolCacheInit(PoolCache* cache, Pool* pool);
+
+// Return all cached slots to the pool.
+void poolCacheDone(PoolCache* cache);
+
+// Allocate a slot through a cache.  Only the owning thread should use the cache.
+void* poolCacheAlloc(PoolCache* cache);
+
+// Free a slot through a cache.  The slot can come from any thread as long as it belongs to the cache's pool.
+void poolCacheFree(PoolCache* cache, void* slot);
+
+#define K_POOL_ALLOC(pool, t) ((t *)poolAlloc(pool))
+#define K_POOL_CACHE_ALLOC(cache, t) ((t *)poolCacheAlloc(cache))
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#ifdef K_IMPLEMENTATION
+
+#if OS_WIN32
+#   define K_POOL_LOCK(pool) AcquireSRWLockExclusive(&(pool)->lock)
+#   define K_POOL_UNLOCK(pool) ReleaseSRWLockExclusive(&(pool)->lock)
+#else
+#   error Implement pool locking for your OS.
+#endif
+
+#define K_POOL_NEXT(slot) (*(void **)(slot))
+
+void poolInit(Pool* pool, i64 slotSize)
+{
+    slotSize = K_MAX(slotSize, (i64)sizeof(void*));
+    slotSize = (slotSize + K_ARENA_ALIGN - 1) / K_ARENA_ALIGN * K_ARENA_ALIGN;
+
+    pool->slotSize = slotSize;
+    pool->pageSize = K_MAX(K_POOL_PAGE_SIZE, (i64)sizeof(PoolPage) + K_ARENA_ALIGN + slotSize * 16);
+    pool->freeList = 0;
+    pool->cursor = 0;
+    pool->end = 0;
+    pool->pages = 0;
+    pool->numaNode = K_NUMA_NONE;
+#if OS_WIN32
+    InitializeSRWLock(&pool->lock);
+#endif
+}
+
+void poolInitNuma(Pool* pool, i64 slotSize, i64 node)
+{
+    poolInit(pool, slotSize);
+    pool->pageSize = __memoryRoundUp(pool->pageSize, K_ARENA_COMMIT_SIZE);
+    pool->numaNode = __memoryNumaResolve(node);
+}
+
+void poolDone(Pool* pool)
+{
+    PoolPage* page = pool->pages;
+    while (page)
+    {
+        PoolPage* next = page->next;
+        if (pool->numaNode == K_NUMA_NONE)
+        {
+            K_FREE(page, page->size);
+        }
+        else
+        {
+            __memoryHugeFree(page);
+        }
+        page = next;
+    }
+
+    pool->freeList = 0;
+    pool->cursor = 0;
+    pool->end = 0;
+    pool->pages = 0;
+}
+
+// Allocate a slot with the lock already held.
+internal void* __poolAlloc(Pool* pool)
+{
+    void* slot = pool->freeList;
+
+    if (slot)
+    {
+        pool->freeList = K_POOL_NEXT(slot);
+    }
+    else
+    {
+        if (pool->cursor + pool->slotSize > pool->end)
+        {
+            // Grab a new page.  Slots are carved from it lazily so untouched parts of the page are never paged in.
+            PoolPage* page = pool->numaNode == K_NUMA_NONE
+                ? (PoolPage *)K_ALLOC(pool->pageSize)
+                : (PoolPage *)__memoryVirtualAlloc(0, pool->pageSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE,
+                    pool->numaNode);
+            if (!page) return 0;
+
+            page->next = pool->pages;
+            page->size = pool->pageSize;
+            pool->pages = page;
+            // Heap pages are only aligned to K_MEMORY_ALIGN, so round the first slot up.  Slot sizes are multiples
+            // of K_ARENA_ALIGN, so the rest follow.
+            pool->cursor = (u8 *)(((uintptr_t)(page + 1) + K_ARENA_ALIGN - 1) & ~(uintptr_t)(K_ARENA_ALIGN - 1));
+            pool->end = (u8 *)page + pool->pageSize;
+        }
+
+        slot = pool->cursor;
+        pool->cursor += pool->slotSize;
+    }
+
+    return slot;
+}
+
+void* poolAlloc(Pool* pool)
+{
+    void* slot;
+
+    K_POOL_LOCK(pool);
+    slot = __poolAlloc(pool);
+    K_POOL_UNLOCK(pool);
+
+    return slot;
+}
+
+void poolFree(Pool* pool, void* slot)
+{
+    if (slot)
+    {
+        K_POOL_LOCK(pool);
+        K_POOL_NEXT(slot) = pool->freeList;
+        pool->freeList = slot;
+        K_POOL_UNLOCK(pool);
+    }
+}
+
+void poolCacheInit(PoolCache* cache, Pool* pool)
+{
+    cache->pool = pool;
+    cache->freeList = 0;
+    cache->count = 0;
+}
+
+// Move numSlots slots from the cache back to the pool in one go.
+internal void __poolCacheFlush(PoolCache* cache, i64 numSlots)
+{
+    void* first = cache->freeList;
+    void* last = first;
+
+    if (!first || numSlots <= 0) return;
+
+    for (i64 i = 1; i < numSlots && K_POOL_NEXT(last); ++i)
+    {
+        last = K_POOL_NEXT(last);
+        --cache->count;
+    }
+    --cache->count;
+    cache->freeList = K_POOL_NEXT(last);
+
+    K_POOL_LOCK(cache->pool);
+    K_POOL_NEXT(last) = cache->pool->freeList;
+    cache->pool->freeList = first;
+    K_POOL_UNLOCK(cache->pool);
+}
+
+void poolCacheDone(PoolCache* cache)
+{
+    __poolCacheFlush(cache, cache->count);
+    cache->pool = 0;
+}
+
+void* poolCacheAlloc(PoolCache* cache)
+{
+    void* slot = cache->freeList;
+
+    if (!slot)
+    {
+        // Refill half the cache in one batch
+        Pool* pool = cache->pool;
+
+        K_POOL_LOCK(pool);
+        for (i64 i = 0; i < K_POOL_CACHE_SIZE / 2; ++i)
+        {
+            void* s = __poolAlloc(pool);
+            if (!s) break;
+            K_POOL_NEXT(s) = cache->freeList;
+            cache->freeList = s;
+            ++cache->count;
+        }
+        K_POOL_UNLOCK(pool);
+
+        slot = cache->freeList;
+        if (!slot) return 0;
+    }
+
+    cache->freeList = K_POOL_NEXT(slot);
+    --cache->count;
+
+    return slot;
+}
+
+void poolCacheFree(PoolCache* cache, void* slot)
+{
+    if (slot)
+    {
+        K_POOL_NEXT(slot) = cache->freeList;
+        cache->freeList = slot;
+        if (++cache->count > K_POOL_CACHE_SIZE)
+        {
+            __poolCacheFlush(cache, K_POOL_CACHE_SIZE / 2);
+        }
+    }
+}
+
+#undef K_POOL_NEXT
+#undef K_POOL_LOCK
+#undef K_POOL_UNLOCK
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#endif // K_IMPLEMENTATION
@@ -0,0 +1,327 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Queue API
+// Bounded lock-free queues for passing fixed-size elements between threads.
+//
+//  SpscQueue   One producer thread and one consumer thread.
+//  MpmcQueue   Any number of producers and consumers.  Based on Dmitry Vyukov's bounded MPMC queue: every cell has a
+//              sequence number that says whether it is ready to be written or read for a given lap of the ring.
+//
+// Capacities are rounded up to a power of two.  The indices written by producers and consumers are on separate cache
+// lines so the two sides do not fight over them.  Push and pop fail rather than block when the queue is full or
+// empty.  The batch functions move as many elements as they can in one go and return how many they moved.
+//
+// The queues rely on the x86/x64 memory model, where stores are not reordered with other stores and loads are not
+// reordered with other loads, so only compiler barriers are needed between touching an element and publishing it.
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+
+typedef struct
+{
+    // Written by the producer
+    volatile i64    tail;           // Next position to write.
+    i64             cachedHead;     // Last value of head the producer saw.
+    u8              pad0[K_CACHE_LINE_SIZE - 2 * sizeof(i64)];
+
+    // Written by the consumer
+    volatile i64    head;           // Next position to read.
+    i64             cachedTail;     // Last value of tail the consumer saw.
+    u8              pad1[K_CACHE_LINE_SIZE - 2 * sizeof(i64)];
+
+    // Read-only after initialisation
+    u8*             buffer;
+    i64             mask;
+    i64             elemSize;
+    u8              pad2[K_CACHE_LINE_SIZE - sizeof(u8*) - 2 * sizeof(i64)];
+}
+SpscQueue;
+
+typedef struct
+{
+    volatile i64    enqueuePos;
+    u8              pad0[K_CACHE_LINE_SIZE - sizeof(i64)];
+    volatile i64    dequeuePos;
+    u8              pad1[K_CACHE_LINE_SIZE - sizeof(i64)];
+
+    // Read-only after initialisation
+    u8*             cells;          // Each cell is a sequence number followed by an element.
+    i64             mask;
+    i64             elemSize;
+    i64             cellSize;
+    u8              pad2[K_CACHE_LINE_SIZE - sizeof(u8*) - 3 * sizeof(i64)];
+}
+MpmcQueue;
+
+// Initialise a single producer/single consumer queue that can hold at least capacity elements.
+void spscQueueInit(SpscQueue* q, i64 elemSize, i64 capacity);
+
+// Release the queue's memory.  No threads can be using it.
+void spscQueueDone(SpscQueue* q);
+
+// Copy an element into the queue.  Returns NO if the queue is full.  Producer thread only.
+bool spscQueuePush(SpscQueue* q, const void* elem);
+
+// Copy up to count elements into the queue and return how many were pushed.  Producer thread only.
+i64 spscQueuePushBatch(SpscQueue* q, const void* elems, i64 count);
+
+// Copy the oldest element out of the queue.  Returns NO if the queue is empty.  Consumer thread only.
+bool spscQueuePop(SpscQueue* q, void* elem);
+
+// Copy up to maxCount elements out of the queue and return how many were popped.  Consumer thread only.
+i64 spscQueuePopBatch(SpscQueue* q, void* elems, i64 maxCount);
+
+// Initialise a multiple producer/multiple consumer queue that can hold at least capacity elements.
+void mpmcQueueInit(MpmcQueue* q, i64 elemSize, i64 capacity);
+
+// Release the queue's memory.  No threads can be using it.
+void mpmcQueueDone(MpmcQueue* q);
+
+// Copy an element into the queue.  Returns NO if the queue is full.
+bool mpmcQueuePush(MpmcQueue* q, const void* elem);
+
+// Copy up to count elements into the queue and return how many were pushed.  The elements are kept together.
+i64 mpmcQueuePushBatch(MpmcQueue* q, const void* elems, i64 count);
+
+// Copy the oldest element out of the queue.  Returns NO if the queue is empty.
+bool mpmcQueuePop(MpmcQueue* q, void* elem);
+
+// Copy up to maxCount consecutive elements out of the queue and return how many were popped.
+i64 mpmcQueuePopBatch(MpmcQueue* q, void* elems, i64 maxCount);
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#ifdef K_IMPLEMENTATION
+
+#if COMPILER_MSVC
+#   include <intrin.h>
+#   define K_QUEUE_BARRIER() _ReadWriteBarrier()
+#else
+#   error Define K_QUEUE_BARRIER for your compiler.
+#endif
+
+internal i64 __queueCapacity(i64 capacity)
+{
+    i64 c = 2;
+    while (c < capacity) c *= 2;
+    return c;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Single producer/single consumer
+//----------------------------------------------------------------------------------------------------------------------
+
+void spscQueueInit(SpscQueue* q, i64 elemSize, i64 capacity)
+{
+    capacity = __queueCapacity(capacity);
+
+    q->tail = 0;
+    q->cachedHead = 0;
+    q->head = 0;
+    q->cachedTail = 0;
+    q->buffer = (u8 *)K_ALLOC_ALIGNED(capacity * elemSize, K_CACHE_LINE_SIZE);
+    q->mask = capacity - 1;
+    q->elemSize = elemSize;
+}
+
+void spscQueueDone(SpscQueue* q)
+{
+    K_FREE_ALIGNED(q->buffer, (q->mask + 1) * q->elemSize, K_CACHE_LINE_SIZE);
+    q->buffer = 0;
+}
+
+// Copy count elements between the ring, starting at a position, and a linear buffer.  Handles wrapping.
+internal void __queueCopyIn(u8* ring, i64 mask, i64 elemSize, i64 pos, const u8* src, i64 count)
+{
+    i64 index = pos & mask;
+    i64 first = K_MIN(count, mask + 1 - index);
+
+    memoryCopy(src, ring + index * elemSize, first * elemSize);
+    if (first < count) memoryCopy(src + first * elemSize, ring, (count - first) * elemSize);
+}
+
+internal void __queueCopyOut(const u8* ring, i64 mask, i64 elemSize, i64 pos, u8* dst, i64 count)
+{
+    i64 index = pos & mask;
+    i64 first = K_MIN(count, mask + 1 - index);
+
+    memoryCopy(ring + index * elemSize, dst, first * elemSize);
+    if (first < count) memoryCopy(ring, dst + first * elemSize, (count - first) * elemSize);
+}
+
+i64 spscQueuePushBatch(SpscQueue* q, const void* elems, i64 count)
+{
+    i64 tail = q->tail;
+    i64 capacity = q->mask + 1;
+
+    // Only read the consumer's index when the cached copy says the queue is full
+    if (tail + count - q->cachedHead > capacity)
+    {
+        q->cachedHead = q->head;
+        K_QUEUE_BARRIER();
+        count = K_MIN(count, capacity - (tail - q->cachedHead));
+        if (count <= 0) return 0;
+    }
+
+    __queueCopyIn(q->buffer, q->mask, q->elemSize, tail, (const u8 *)elems, count);
+    K_QUEUE_BARRIER();
+    q->tail = tail + count;
+
+    return count;
+}
+
+bool spscQueuePush(SpscQueue* q, const void* elem)
+{
+    return spscQueuePushBatch(q, elem, 1) == 1;
+}
+
+i64 spscQueuePopBatch(SpscQueue* q, void* elems, i64 maxCount)
+{
+    i64 head = q->head;
+    i64 count = maxCount;
+
+    if (head + count > q->cachedTail)
+    {
+        q->cachedTail = q->tail;
+        K_QUEUE_BARRIER();
+        count = K_MIN(count, q->cachedTail - head);
+        if (count <= 0) return 0;
+    }
+
+    __queueCopyOut(q->buffer, q->mask, q->elemSize, head, (u8 *)elems, count);
+    K_QUEUE_BARRIER();
+    q->head = head + count;
+
+    return count;
+}
+
+bool spscQueuePop(SpscQueue* q, void* elem)
+{
+    return spscQueuePopBatch(q, elem, 1) == 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Multiple producer/multiple consumer
+//
+// A cell at position pos is ready to be written when its sequence is pos, and ready to be read when it is pos + 1.
+// Reading it sets the sequence to pos + capacity, ready for the next lap.  A thread claims a run of cells by moving
+// enqueuePos or dequeuePos past them with a compare and swap.
+//----------------------------------------------------------------------------------------------------------------------
+
+#define K_QUEUE_CELL_SEQ(q, pos) (*(volatile i64 *)((q)->cells + ((pos) & (q)->mask) * (q)->cellSize))
+#define K_QUEUE_CELL_DATA(q, pos) ((q)->cells + ((pos) & (q)->mask) * (q)->cellSize + sizeof(i64))
+
+void mpmcQueueInit(MpmcQueue* q, i64 elemSize, i64 capacity)
+{
+    capacity = __queueCapacity(capacity);
+
+    q->enqueuePos = 0;
+    q->dequeuePos = 0;
+    q->elemSize = elemSize;
+    q->cellSize = (sizeof(i64) + elemSize + 7) & ~7;
+    q->mask = capacity - 1;
+    q->cells = (u8 *)K_ALLOC_ALIGNED(capacity * q->cellSize, K_CACHE_LINE_SIZE);
+
+    for (i64 i = 0; i < capacity; ++i)
+    {
+        K_QUEUE_CELL_SEQ(q, i) = i;
+    }
+}
+
+void mpmcQueueDone(MpmcQueue* q)
+{
+    K_FREE_ALIGNED(q->cells, (q->mask + 1) * q->cellSize, K_CACHE_LINE_SIZE);
+    q->cells = 0;
+}
+
+// Claim up to maxCount consecutive cells whose sequence is their position plus delta.  Returns how many cells were
+// claimed and the first position in *start.
+internal i64 __mpmcQueueClaim(MpmcQueue* q, volatile i64* cursor, i64 delta, i64 maxCount, i64* start)
+{
+    i64 pos = *cursor;
+
+    // Nothing would ever be claimed, so the loop below would never end
+    if (maxCount <= 0) return 0;
+
+    for (;;)
+    {
+        i64 count = 0;
+        i64 diff;
+
+        while (count < maxCount && K_QUEUE_CELL_SEQ(q, pos + count) == pos + count + delta) ++count;
+
+        if (count)
+        {
+            i64 seen = _InterlockedCompareExchange64(cursor, pos + count, pos);
+            if (seen == pos)
+            {
+                *start = pos;
+                return count;
+            }
+            pos = seen;
+            continue;
+        }
+
+        // The first cell is not ready.  If it is a lap behind, the queue is full (or empty), otherwise another thread
+        // got there first.
+        diff = K_QUEUE_CELL_SEQ(q, pos) - (pos + delta);
+        if (diff < 0) return 0;
+        pos = *cursor;
+    }
+}
+
+i64 mpmcQueuePushBatch(MpmcQueue* q, const void* elems, i64 count)
+{
+    const u8* src = (const u8 *)elems;
+    i64 pos;
+
+    count = __mpmcQueueClaim(q, &q->enqueuePos, 0, count, &pos);
+    for (i64 i = 0; i < count; ++i)
+    {
+        memoryCopy(src + i * q->elemSize, K_QUEUE_CELL_DATA(q, pos + i), q->elemSize);
+        K_QUEUE_BARRIER();
+        K_QUEUE_CELL_SEQ(q, pos + i) = pos + i + 1;
+    }
+
+    return count;
+}
+
+bool mpmcQueuePush(MpmcQueue* q, const void* elem)
+{
+    return mpmcQueuePushBatch(q, elem, 1) == 1;
+}
+
+i64 mpmcQueuePopBatch(MpmcQueue* q, void* elems, i64 maxCount)
+{
+    u8* dst = (u8 *)elems;
+    i64 pos;
+    i64 count = __mpmcQueueClaim(q, &q->dequeuePos, 1, maxCount, &pos);
+
+    for (i64 i = 0; i < count; ++i)
+    {
+        memoryCopy(K_QUEUE_CELL_DATA(q, pos + i), dst + i * q->elemSize, q->elemSize);
+        K_QUEUE_BARRIER();
+        K_QUEUE_CELL_SEQ(q, pos + i) = pos + i + q->mask + 1;
+    }
+
+    return count;
+}
+
+bool mpmcQueuePop(MpmcQueue* q, void* elem)
+{
+    return mpmcQueuePopBatch(q, elem, 1) == 1;
+}
+
+#undef K_QUEUE_CELL_SEQ
+#undef K_QUEUE_CELL_DATA
+#undef K_QUEUE_BARRIER
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#endif // K_IMPLEMENTATION
@@ -0,0 +1,553 @@
+//----------------------------------------------------------------------------------------------------------------------
+// Sorting API
+// Radix sorts for integer and floating point keys, with or without a value per key.
+//
+//  sortU32/U64/F32             LSD radix sort, 8 bits per pass.  Needs a temporary buffer the same size as the data.
+//                              The histograms for all passes are built in a single read of the keys and passes
+//                              where every key has the same digit are skipped.
+//  sortU32Pairs etc.           Same, but values are moved along with their keys.  The sort is stable.
+//  sortU32InPlace/U64InPlace   MSD radix sort (American flag sort) that needs no extra memory.  Not stable.
+//
+// Runs of up to 16 u32 or f32 keys are sorted with an SSE4.1 sorting network.  Other small runs use insertion sort.
+// Floating point keys are sorted in IEEE total order, so -0 comes before +0 and NaNs end up at the ends.
+//
+// To sort an Array, pass it with its count: sortU32(a, arrayCount(a)).
+//----------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <kore/k_platform.h>
+#include <kore/k_memory.h>
+
+// Below this many keys the LSD sorts use insertion sort and the MSD sorts stop recursing.
+#ifndef K_SORT_SMALL
+#   define K_SORT_SMALL    64
+#endif
+
+// How many keys ahead to prefetch while building histograms and scattering.
+#ifndef K_SORT_PREFETCH
+#   define K_SORT_PREFETCH 64
+#endif
+
+void sortU32(u32* keys, i64 count);
+void sortU64(u64* keys, i64 count);
+void sortF32(f32* keys, i64 count);
+
+void sortU32Pairs(u32* keys, u32* values, i64 count);
+void sortU64Pairs(u64* keys, u64* values, i64 count);
+void sortF32Pairs(f32* keys, u32* values, i64 count);
+
+void sortU32InPlace(u32* keys, i64 count);
+void sortU64InPlace(u64* keys, i64 count);
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#ifdef K_IMPLEMENTATION
+
+#if COMPILER_MSVC
+#   include <intrin.h>
+#endif
+
+#if CPU_X86 || CPU_X64
+#   include <smmintrin.h>
+#   define K_SORT_PREFETCH_READ(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#else
+#   define K_SORT_PREFETCH_READ(p)
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+// Small runs
+//----------------------------------------------------------------------------------------------------------------------
+
+internal void __sortInsertionU32(u32* keys, u32* values, i64 count)
+{
+    for (i64 i = 1; i < count; ++i)
+    {
+        u32 k = keys[i];
+        u32 v = values ? values[i] : 0;
+        i64 j = i;
+
+        for (; j > 0 && keys[j - 1] > k; --j)
+        {
+            keys[j] = keys[j - 1];
+            if (values) values[j] = values[j - 1];
+        }
+        keys[j] = k;
+        if (values) values[j] = v;
+    }
+}
+
+internal void __sortInsertionU64(u64* keys, u64* values, i64 count)
+{
+    for (i64 i = 1; i < count; ++i)
+    {
+        u64 k = keys[i];
+        u64 v = values ? values[i] : 0;
+        i64 j = i;
+
+        for (; j > 0 && keys[j - 1] > k; --j)
+        {
+            keys[j] = keys[j - 1];
+            if (values) values[j] = values[j - 1];
+        }
+        keys[j] = k;
+        if (values) values[j] = v;
+    }
+}
+
+#if CPU_X86 || CPU_X64
+
+// -1 = not checked yet, otherwise whether the CPU has SSE4.1
+int gSortHasSse41 = -1;
+
+internal bool __sortCanUseNetwork()
+{
+    if (gSortHasSse41 < 0)
+    {
+        int info[4];
+        __cpuid(info, 1);
+        gSortHasSse41 = K_BOOL(info[2] & (1 << 19));
+    }
+
+    return (bool)gSortHasSse41;
+}
+
+// Sort a bitonic sequence of 4 keys
+internal __m128i __sortBitonic4(__m128i v)
+{
+    __m128i s = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    v = _mm_blend_epi16(_mm_min_epu32(v, s), _mm_max_epu32(v, s), 0xf0);
+    s = _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_blend_epi16(_mm_min_epu32(v, s), _mm_max_epu32(v, s), 0xcc);
+}
+
+// Merge two sorted runs of 4 keys into a sorted run of 8 in lo:hi
+internal void __sortMerge4(__m128i a, __m128i b, __m128i* lo, __m128i* hi)
+{
+    b = _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 1, 2, 3));
+    *lo = __sortBitonic4(_mm_min_epu32(a, b));
+    *hi = __sortBitonic4(_mm_max_epu32(a, b));
+}
+
+// Merge two sorted runs of 8 keys (a0:a1 and b0:b1) into a sorted run of 16 in r
+internal void __sortMerge8(__m128i a0, __m128i a1, __m128i b0, __m128i b1, __m128i r[4])
+{
+    __m128i rb0 = _mm_shuffle_epi32(b1, _MM_SHUFFLE(0, 1, 2, 3));
+    __m128i rb1 = _mm_shuffle_epi32(b0, _MM_SHUFFLE(0, 1, 2, 3));
+    __m128i l0 = _mm_min_epu32(a0, rb0);
+    __m128i l1 = _mm_min_epu32(a1, rb1);
+    __m128i h0 = _mm_max_epu32(a0, rb0);
+    __m128i h1 = _mm_max_epu32(a1, rb1);
+
+    r[0] = __sortBitonic4(_mm_min_epu32(l0, l1));
+    r[1] = __sortBitonic4(_mm_max_epu32(l0, l1));
+    r[2] = __sortBitonic4(_mm_min_epu32(h0, h1));
+    r[3] = __sortBitonic4(_mm_max_epu32(h0, h1));
+}
+
+// Sort up to 16 keys.  They are padded to 16 with the largest key, sorted as 4 columns of 4 with a sorting network,
+// transposed into 4 sorted rows and then merged with bitonic merges.
+internal void __sortNetworkU32(u32* keys, i64 count)
+{
+    u32 buffer[16];
+    __m128i r[4];
+    __m128i t0, t1, t2, t3;
+    __m128i m0, m1, m2, m3;
+
+    for (i64 i = 0; i < 16; ++i) buffer[i] = i < count ? keys[i] : 0xffffffff;
+
+    r[0] = _mm_loadu_si128((const __m128i *)buffer + 0);
+    r[1] = _mm_loadu_si128((const __m128i *)buffer + 1);
+    r[2] = _mm_loadu_si128((const __m128i *)buffer + 2);
+    r[3] = _mm_loadu_si128((const __m128i *)buffer + 3);
+
+#define K_SORT_CSWAP(a, b) t0 = _mm_min_epu32(r[a], r[b]); r[b] = _mm_max_epu32(r[a], r[b]); r[a] = t0
+    K_SORT_CSWAP(0, 1);
+    K_SORT_CSWAP(2, 3);
+    K_SORT_CSWAP(0, 2);
+    K_SORT_CSWAP(1, 3);
+    K_SORT_CSWAP(1, 2);
+#undef K_SORT_CSWAP
+
+    t0 = _mm_unpacklo_epi32(r[0], r[1]);
+    t1 = _mm_unpacklo_epi32(r[2], r[3]);
+    t2 = _mm_unpackhi_epi32(r[0], r[1]);
+    t3 = _mm_unpackhi_epi32(r[2], r[3]);
+    r[0] = _mm_unpacklo_epi64(t0, t1);
+    r[1] = _mm_unpackhi_epi64(t0, t1);
+    r[2] = _mm_unpacklo_epi64(t2, t3);
+    r[3] = _mm_unpackhi_epi64(t2, t3);
+
+    __sortMerge4(r[0], r[1], &m0, &m1);
+    __sortMerge4(r[2], r[3], &m2, &m3);
+    __sortMerge8(m0, m1, m2, m3, r);
+
+    _mm_storeu_si128((__m128i *)buffer + 0, r[0]);
+    _mm_storeu_si128((__m128i *)buffer + 1, r[1]);
+    _mm_storeu_si128((__m128i *)buffer + 2, r[2]);
+    _mm_storeu_si128((__m128i *)buffer + 3, r[3]);
+    for (i64 i = 0; i < count; ++i) keys[i] = buffer[i];
+}
+
+#else
+
+internal bool __sortCanUseNetwork()
+{
+    return NO;
+}
+
+internal void __sortNetworkU32(u32* keys, i64 count)
+{
+    __sortInsertionU32(keys, 0, count);
+}
+
+#endif // CPU_X86 || CPU_X64
+
+internal void __sortSmallU32(u32* keys, u32* values, i64 count)
+{
+    if (!values && count <= 16 && __sortCanUseNetwork())
+    {
+        __sortNetworkU32(keys, count);
+    }
+    else
+    {
+        __sortInsertionU32(keys, values, count);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// LSD radix sort
+//----------------------------------------------------------------------------------------------------------------------
+
+internal void __sortRadixU32(u32* keys, u32* values, i64 count)
+{
+    i64 hist[4][256] = { 0 };
+    u32* tempKeys;
+    u32* tempValues = 0;
+    u32* srcKeys = keys;
+    u32* srcValues = values;
+    u32* dstKeys;
+    u32* dstValues;
+
+    if (count <= K_SORT_SMALL)
+    {
+        __sortSmallU32(keys, values, count);
+        return;
+    }
+
+    for (i64 i = 0; i < count; ++i)
+    {
+        u32 k = keys[i];
+        K_SORT_PREFETCH_READ(&keys[i + K_SORT_PREFETCH]);
+        ++hist[0][k & 0xff];
+        ++hist[1][(k >> 8) & 0xff];
+        ++hist[2][(k >> 16) & 0xff];
+        ++hist[3][k >> 24];
+    }
+
+    tempKeys = (u32 *)K_ALLOC_ALIGNED(count * sizeof(u32), K_CACHE_LINE_SIZE);
+    if (values) tempValues = (u32 *)K_ALLOC_ALIGNED(count * sizeof(u32), K_CACHE_LINE_SIZE);
+    dstKeys = tempKeys;
+    dstValues = tempValues;
+
+    for (int pass = 0; pass < 4; ++pass)
+    {
+        int shift = pass * 8;
+        i64 offsets[256];
+        i64 total = 0;
+
+        // Skip passes that would not move anything
+        if (hist[pass][(srcKeys[0] >> shift) & 0xff] == count) continue;
+
+        for (int d = 0; d < 256; ++d)
+        {
+            offsets[d] = total;
+            total += hist[pass][d];
+        }
+
+        for (i64 i = 0; i < count; ++i)
+        {
+            u32 k = srcKeys[i];
+            i64 o = offsets[(k >> shift) & 0xff]++;
+
+            K_SORT_PREFETCH_READ(&srcKeys[i + K_SORT_PREFETCH]);
+            dstKeys[o] = k;
+            if (values) dstValues[o] = srcValues[i];
+        }
+
+        K_SWAP(u32*, srcKeys, dstKeys);
+        K_SWAP(u32*, srcValues, dstValues);
+    }
+
+    if (srcKeys != keys)
+    {
+        memoryCopy(srcKeys, keys, count * sizeof(u32));
+        if (values) memoryCopy(srcValues, values, count * sizeof(u32));
+    }
+
+    K_FREE_ALIGNED(tempKeys, count * sizeof(u32), K_CACHE_LINE_SIZE);
+    if (values) K_FREE_ALIGNED(tempValues, count * sizeof(u32), K_CACHE_LINE_SIZE);
+}
+
+internal void __sortRadixU64(u64* keys, u64* values, i64 count)
+{
+    i64 hist[8][256] = { 0 };
+    u64* tempKeys;
+    u64* tempValues = 0;
+    u64* srcKeys = keys;
+    u64* srcValues = values;
+    u64* dstKeys;
+    u64* dstValues;
+
+    if (count <= K_SORT_SMALL)
+    {
+        __sortInsertionU64(keys, values, count);
+        return;
+    }
+
+    for (i64 i = 0; i < count; ++i)
+    {
+        u64 k = keys[i];
+        K_SORT_PREFETCH_READ(&keys[i + K_SORT_PREFETCH]);
+        for (int pass = 0; pass < 8; ++pass)
+        {
+            ++hist[pass][(k >> (pass * 8)) & 0xff];
+        }
+    }
+
+    tempKeys = (u64 *)K_ALLOC_ALIGNED(count * sizeof(u64), K_CACHE_LINE_SIZE);
+    if (values) tempValues = (u64 *)K_ALLOC_ALIGNED(count * sizeof(u64), K_CACHE_LINE_SIZE);
+    dstKeys = tempKeys;
+    dstValues = tempValues;
+
+    for (int pass = 0; pass < 8; ++pass)
+    {
+        int shift = pass * 8;
+        i64 offsets[256];
+        i64 total = 0;
+
+        if (hist[pass][(srcKeys[0] >> shift) & 0xff] == count) continue;
+
+        for (int d = 0; d < 256; ++d)
+        {
+            offsets[d] = total;
+            total += hist[pass][d];
+        }
+
+        for (i64 i = 0; i < count; ++i)
+        {
+            u64 k = srcKeys[i];
+            i64 o = offsets[(k >> shift) & 0xff]++;
+
+            K_SORT_PREFETCH_READ(&srcKeys[i + K_SORT_PREFETCH]);
+            dstKeys[o] = k;
+            if (values) dstValues[o] = srcValues[i];
+        }
+
+        K_SWAP(u64*, srcKeys, dstKeys);
+        K_SWAP(u64*, srcValues, dstValues);
+    }
+
+    if (srcKeys != keys)
+    {
+        memoryCopy(srcKeys, keys, count * sizeof(u64));
+        if (values) memoryCopy(srcValues, values, count * sizeof(u64));
+    }
+
+    K_FREE_ALIGNED(tempKeys, count * sizeof(u64), K_CACHE_LINE_SIZE);
+    if (values) K_FREE_ALIGNED(tempValues, count * sizeof(u64), K_CACHE_LINE_SIZE);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Floating point keys
+// Flipping the sign bit of positive numbers and all the bits of negative ones gives integers that sort in the same
+// order as the floats.
+//----------------------------------------------------------------------------------------------------------------------
+
+internal void __sortF32ToKeys(u32* keys, i64 count)
+{
+    for (i64 i = 0; i < count; ++i)
+    {
+        u32 k = keys[i];
+        keys[i] = k ^ ((u32)(-(i32)(k >> 31)) | 0x80000000);
+    }
+}
+
+internal void __sortKeysToF32(u32* keys, i64 count)
+{
+    for (i64 i = 0; i < count; ++i)
+    {
+        u32 k = keys[i];
+        keys[i] = k ^ (((k >> 31) - 1) | 0x80000000);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// MSD in-place radix sort
+// Each level counts the digits, then cycles keys directly into their buckets by swapping, and recurses into each
+// bucket on the next digit down.
+//----------------------------------------------------------------------------------------------------------------------
+
+internal void __sortMsdU32(u32* keys, i64 count, int shift)
+{
+    i64 heads[256];
+    i64 tails[256];
+    i64 total = 0;
+
+    if (count <= K_SORT_SMALL)
+    {
+        __sortSmallU32(keys, 0, count);
+        return;
+    }
+
+    for (int d = 0; d < 256; ++d) tails[d] = 0;
+    for (i64 i = 0; i < count; ++i)
+    {
+        K_SORT_PREFETCH_READ(&keys[i + K_SORT_PREFETCH]);
+        ++tails[(keys[i] >> shift) & 0xff];
+    }
+    for (int d = 0; d < 256; ++d)
+    {
+        heads[d] = total;
+        total += tails[d];
+        tails[d] = total;
+    }
+
+    for (int d = 0; d < 256; ++d)
+    {
+        while (heads[d] < tails[d])
+        {
+            u32 k = keys[heads[d]];
+            int kd = (k >> shift) & 0xff;
+
+            while (kd != d)
+            {
+                K_SWAP(u32, k, keys[heads[kd]]);
+                ++heads[kd];
+                kd = (k >> shift) & 0xff;
+            }
+            keys[heads[d]++] = k;
+        }
+    }
+
+    if (shift > 0)
+    {
+        i64 start = 0;
+        for (int d = 0; d < 256; ++d)
+        {
+            __sortMsdU32(keys + start, tails[d] - start, shift - 8);
+            start = tails[d];
+        }
+    }
+}
+
+internal void __sortMsdU64(u64* keys, i64 count, int shift)
+{
+    i64 heads[256];
+    i64 tails[256];
+    i64 total = 0;
+
+    if (count <= K_SORT_SMALL)
+    {
+        __sortInsertionU64(keys, 0, count);
+        return;
+    }
+
+    for (int d = 0; d < 256; ++d) tails[d] = 0;
+    for (i64 i = 0; i < count; ++i)
+    {
+        K_SORT_PREFETCH_READ(&keys[i + K_SORT_PREFETCH]);
+        ++tails[(keys[i] >> shift) & 0xff];
+    }
+    for (int d = 0; d < 256; ++d)
+    {
+        heads[d] = total;
+        total += tails[d];
+        tails[d] = total;
+    }
+
+    for (int d = 0; d < 256; ++d)
+    {
+        while (heads[d] < tails[d])
+        {
+            u64 k = keys[heads[d]];
+            int kd = (int)((k >> shift) & 0xff);
+
+            while (kd != d)
+            {
+                K_SWAP(u64, k, keys[heads[kd]]);
+                ++heads[kd];
+                kd = (int)((k >> shift) & 0xff);
+            }
+            keys[heads[d]++] = k;
+        }
+    }
+
+    if (shift > 0)
+    {
+        i64 start = 0;
+        for (int d = 0; d < 256; ++d)
+        {
+            __sortMsdU64(keys + start, tails[d] - start, shift - 8);
+            start = tails[d];
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Public API
+//----------------------------------------------------------------------------------------------------------------------
+
+void sortU32(u32* keys, i64 count)
+{
+    __sortRadixU32(keys, 0, count);
+}
+
+void sortU64(u64* keys, i64 count)
+{
+    __sortRadixU64(keys, 0, count);
+}
+
+void sortF32(f32* keys, i64 count)
+{
+    __sortF32ToKeys((u32 *)keys, count);
+    __sortRadixU32((u32 *)keys, 0, count);
+    __sortKeysToF32((u32 *)keys, count);
+}
+
+void sortU32Pairs(u32* keys, u32* values, i64 count)
+{
+    __sortRadixU32(keys, values, count);
+}
+
+void sortU64Pairs(u64* keys, u64* values, i64 count)
+{
+    __sortRadixU64(keys, values, count);
+}
+
+void sortF32Pairs(f32* keys, u32* values, i64 count)
+{
+    __sortF32ToKeys((u32 *)keys, count);
+    __sortRadixU32((u32 *)keys, values, count);
+    __sortKeysToF32((u32 *)keys, count);
+}
+
+void sortU32InPlace(u32* keys, i64 count)
+{
+    __sortMsdU32(keys, count, 24);
+}
+
+void sortU64InPlace(u64* keys, i64 count)
+{
+    __sortMsdU64(keys, count, 56);
+}
+
+#undef K_SORT_PREFETCH_READ
+
+//----------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------------------------
+
+#endif // K_IMPLEMENTATION
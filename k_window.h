@@ -7,11 +7,12 @@
 #include <kore/k_platform.h>
 #include <kore/k_memory.h>
 
-typedef int Window;
+// Windows are slot map handles.  A handle to a window that has been destroyed is ignored.
+typedef Handle Window;
 
 // Create a window for an image of a certain size and scale it up by a factor.
 // The image format must be in BGRA BGRA... format.  However, if you fetch a u32 on a little endian system,
-// the u32 will be in format ARGB.
+// the u32 will be in format ARGB.  Returns 0 if the window could not be created.
 Window windowMake(const char* title, u32* image, int width, int height, int scale);
 
 // Close the window
@@ -78,37 +79,29 @@ typedef struct
 }
 WindowInfo;
 
-Array(WindowInfo) gWindows = 0;
+SlotMap gWindows = { 0 };
 int gWindowCount = 0;
 #if OS_WIN32
 ATOM gWindowClassAtom = 0;
 #endif
 
-internal Window __windowAllocHandle()
+internal WindowInfo* __windowInfo(Window window)
 {
-    for (int i = 0; i < arrayCount(gWindows); ++i)
-    {
-        if (gWindows[i].handle == 0)
-        {
-            return i;
-        }
-    }
-
-    gWindows = arrayExpand(gWindows, 1);
-    return (Window)(arrayCount(gWindows) - 1);
+    return K_SLOTMAP_GET(&gWindows, window, WindowInfo);
 }
 
-
 #if OS_WIN32
-internal Window __windowFindHandle(HWND wnd)
+// A window's handle is kept in its extra window memory so messages can find the window without searching.  It is
+// stored as two 32-bit halves so it fits on 32-bit builds too.
+internal void __windowSetHandle(HWND wnd, Window window)
 {
-    i64 count = arrayCount(gWindows);
-    for (int i = 0; i < count; ++i)
-    {
-        if (gWindows[i].handle == wnd) return i;
-    }
+    SetWindowLongA(wnd, 0, (LONG)(u32)window);
+    SetWindowLongA(wnd, 4, (LONG)(u32)(window >> 32));
+}
 
-    return -1;
+internal Window __windowGetHandle(HWND wnd)
+{
+    return (Window)(u32)GetWindowLongA(wnd, 0) | ((Window)(u32)GetWindowLongA(wnd, 4) << 32);
 }
 
 typedef struct WindowCreateInfo
@@ -123,12 +116,13 @@ internal LRESULT CALLBACK __windowProc(HWND wnd, UINT msg, WPARAM w, LPARAM l)
     {
         CREATESTRUCTA* cs = (CREATESTRUCTA *)l;
         WindowCreateInfo* wci = (WindowCreateInfo *)cs->lpCreateParams;
-        gWindows[wci->handle].handle = wnd;
+        __windowInfo(wci->handle)->handle = wnd;
+        __windowSetHandle(wnd, wci->handle);
     }
     else
     {
-        Window window = __windowFindHandle(wnd);
-        WindowInfo* info = (window == -1 ? 0 : &gWindows[window]);
+        Window window = __windowGetHandle(wnd);
+        WindowInfo* info = __windowInfo(window);
 
         switch (msg)
         {
@@ -174,19 +168,19 @@ internal LRESULT CALLBACK __windowProc(HWND wnd, UINT msg, WPARAM w, LPARAM l)
             {
                 PostQuitMessage(0);
             }
-            info->handle = 0;
+            slotMapRemove(&gWindows, window);
             break;
 
         case WM_KEYDOWN:
-            if (info->evKeyDown) info->evKeyDown(window, (u32)w);
+            if (info && info->evKeyDown) info->evKeyDown(window, (u32)w);
             break;
 
         case WM_KEYUP:
-            if (info->evKeyUp) info->evKeyDown(window, (u32)w);
+            if (info && info->evKeyUp) info->evKeyUp(window, (u32)w);
             break;
 
         case WM_CHAR:
-            if (info->evChar) info->evChar(window, (char)w);
+            if (info && info->evChar) info->evChar(window, (char)w);
             break;
 
         default:
@@ -201,18 +195,22 @@ internal LRESULT CALLBACK __windowProc(HWND wnd, UINT msg, WPARAM w, LPARAM l)
 Window windowMake(const char* title, u32* image, int width, int height, int scale)
 {
     WindowCreateInfo wci;
-    Window w = __windowAllocHandle();
+    WindowInfo* info;
+    Window w;
 
-    memoryClear(&gWindows[w], sizeof(WindowInfo));
+    if (!gWindows.elemSize) K_SLOTMAP_INIT(&gWindows, WindowInfo);
+    info = K_SLOTMAP_ADD(&gWindows, WindowInfo, &w);
+
+    memoryClear(info, sizeof(WindowInfo));
 
     wci.handle = w;
 
-    gWindows[w].handle = 0;
-    gWindows[w].image = image;
-    gWindows[w].imgWidth = width;
-    gWindows[w].imgHeight = height;
-    gWindows[w].wndWidth = width * scale;
-    gWindows[w].wndHeight = width * scale;
+    info->handle = 0;
+    info->image = image;
+    info->imgWidth = width;
+    info->imgHeight = height;
+    info->wndWidth = width * scale;
+    info->wndHeight = width * scale;
 
 #if OS_WIN32
     RECT r = { 0, 0, width * scale, height * scale };
@@ -225,6 +223,7 @@ Window windowMake(const char* title, u32* image, int width, int height, int scal
         wc.cbSize = sizeof(WNDCLASSEXA);
         wc.style = CS_HREDRAW | CS_VREDRAW;
         wc.lpfnWndProc = &__windowProc;
+        wc.cbWndExtra = sizeof(Window);
         wc.hInstance = GetModuleHandleA(0);
         wc.hIcon = wc.hIconSm = LoadIconA(0, IDI_APPLICATION);
         wc.hCursor = LoadCursorA(0, IDC_ARROW);
@@ -236,10 +235,14 @@ Window windowMake(const char* title, u32* image, int width, int height, int scal
 
     AdjustWindowRect(&r, style, FALSE);
 
-    gWindows[w].handle = CreateWindowA("k_bitmap_window", title, style,
+    if (!CreateWindowA("k_bitmap_window", title, style,
         CW_USEDEFAULT, CW_USEDEFAULT,
         r.right - r.left, r.bottom - r.top,
-        0, 0, GetModuleHandleA(0), &wci);
+        0, 0, GetModuleHandleA(0), &wci))
+    {
+        slotMapRemove(&gWindows, w);
+        return 0;
+    }
 #else
 #   error Implement window creation for your platform
 #endif
@@ -252,7 +255,8 @@ Window windowMake(const char* title, u32* image, int width, int height, int scal
 void windowClose(Window window)
 {
 #if OS_WIN32
-    SendMessageA(gWindows[window].handle, WM_CLOSE, 0, 0);
+    WindowInfo* info = __windowInfo(window);
+    if (info) SendMessageA(info->handle, WM_CLOSE, 0, 0);
 #endif
 }
 
@@ -289,7 +293,8 @@ void windowUnlock()
 void windowRedraw(Window window)
 {
 #if OS_WIN32
-    InvalidateRect(gWindows[window].handle, 0, FALSE);
+    WindowInfo* info = __windowInfo(window);
+    if (info) InvalidateRect(info->handle, 0, FALSE);
 #else
 #   error Implement windowRedraw for your OS
 #endif
@@ -297,17 +302,20 @@ void windowRedraw(Window window)
 
 int windowWidth(Window window)
 {
-    return gWindows[window].imgWidth;
+    WindowInfo* info = __windowInfo(window);
+    return info ? info->imgWidth : 0;
 }
 
 int windowHeight(Window window)
 {
-    return gWindows[window].imgHeight;
+    WindowInfo* info = __windowInfo(window);
+    return info ? info->imgHeight : 0;
 }
 
 u32* windowImage(Window window)
 {
-    return gWindows[window].image;
+    WindowInfo* info = __windowInfo(window);
+    return info ? info->image : 0;
 }
 
 void windowEnableANSIColours()
@@ -347,17 +355,20 @@ void windowConsolePause()
 
 void windowHandleKeyDownEvent(Window window, WindowKeyDownEvent handler)
 {
-    gWindows[window].evKeyDown = handler;
+    WindowInfo* info = __windowInfo(window);
+    if (info) info->evKeyDown = handler;
 }
 
 void windowHandleKeyUpEvent(Window window, WindowKeyUpEvent handler)
 {
-    gWindows[window].evKeyUp = handler;
+    WindowInfo* info = __windowInfo(window);
+    if (info) info->evKeyUp = handler;
 }
 
 void windowHandleCharEvent(Window window, WindowCharEvent handler)
 {
-    gWindows[window].evChar = handler;
+    WindowInfo* info = __windowInfo(window);
+    if (info) info->evChar = handler;
 }
 
 //----------------------------------------------------------------------------------------------------------------------